@@ -4,5 +4,8 @@
 
 USER_OBJS :=
 
-LIBS := -lm -lusb
+LIBS := -lm -lusb -lpthread -lrt
+
+# the tests link a simulated device in place of libusb
+TEST_LIBS := -lm -lpthread -lrt
 
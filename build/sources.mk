@@ -5,13 +5,16 @@
 OBJ_SRCS := 
 ASM_SRCS := 
 C_SRCS := 
+CPP_SRCS := 
 O_SRCS := 
 S_UPPER_SRCS := 
 EXECUTABLES := 
 OBJS := 
 C_DEPS := 
+CPP_DEPS := 
 
 # Every subdirectory with source files must be described here
 SUBDIRS := \
 src \
+test \
 
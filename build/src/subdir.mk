@@ -5,18 +5,37 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
 ../src/CCS_Series_Drv.c \
+../src/ccsd.c \
+../src/ccspeak.c \
+../src/ccsshm.c \
+../src/ccsstream.c \
+../src/ccswl.c \
 ../src/spxdrv.c \
 ../src/spxusb.c \
 ../src/thorspec.c 
 
 OBJS += \
 ./src/CCS_Series_Drv.o \
+./src/ccspeak.o \
+./src/ccsshm.o \
+./src/ccsstream.o \
+./src/ccswl.o \
 ./src/spxdrv.o \
-./src/spxusb.o \
+./src/spxusb.o 
+
+THORSPEC_OBJS += \
 ./src/thorspec.o 
 
+CCSD_OBJS += \
+./src/ccsd.o 
+
 C_DEPS += \
 ./src/CCS_Series_Drv.d \
+./src/ccsd.d \
+./src/ccspeak.d \
+./src/ccsshm.d \
+./src/ccsstream.d \
+./src/ccswl.d \
 ./src/spxdrv.d \
 ./src/spxusb.d \
 ./src/thorspec.d 
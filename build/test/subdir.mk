@@ -0,0 +1,49 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables 
+C_SRCS += \
+../test/test_drops.c \
+../test/test_q16.c \
+../test/usbmock.c 
+
+CPP_SRCS += \
+../test/test_async.cpp 
+
+TEST_OBJS += \
+./test/usbmock.o 
+
+TEST_Q16_OBJS += \
+./test/test_q16.o 
+
+TEST_DROPS_OBJS += \
+./test/test_drops.o 
+
+TEST_ASYNC_OBJS += \
+./test/test_async.o 
+
+C_DEPS += \
+./test/test_drops.d \
+./test/test_q16.d \
+./test/usbmock.d 
+
+CPP_DEPS += \
+./test/test_async.d 
+
+
+# Each subdirectory must supply rules for building sources it contributes
+test/%.o: ../test/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: GCC C Compiler'
+	gcc -I../src -O3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+test/%.o: ../test/%.cpp
+	@echo 'Building file: $<'
+	@echo 'Invoking: GCC C++ Compiler'
+	g++ -std=c++20 -I../src -O3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
@@ -55,6 +55,7 @@
 #include "vitypes.h"
 #include "CCS_Series_Drv.h"
 #include "spxusb.h"
+#include "ccsgeom.h"
 #define __declspec(dllexport)
 
 /*===========================================================================
@@ -88,7 +89,6 @@
 
 // Buffers
 #define CCS_SERIES_SERIAL_NO_LENGTH          24
-#define CCS_SERIES_NUM_POLY_POINTS           4
 #define CCS_SERIES_NUM_INTEG_CTRL_BYTES      6
 #define CCS_SERIES_NUM_VERSION_BYTES         3
 
@@ -112,11 +112,15 @@
 
 // Macros for Cypress USB chip
 #define ENDPOINT_0_TRANSFERSIZE     64          // this is the max. size of bytes that can be transferred at once for Endpoint 0
+
+#define DROP_INTERVALS              9           // arrival intervals the scan period is estimated from
+#define DROP_MIN_INTERVALS          3           // no losses are inferred from fewer
+#define DROP_SLACK                  0.05        // of a period, for the error of the estimate
 //#define MAX_USB_CTRL_TRANSFER_SIZE  4096        // this is the absolute maximum size for a USB control transfer size
 
 // Analysis 
-#define MATRIX_ROWS  4
-#define MATRIX_COLS  4
+#define FIT_CENTER   ((CCS_SERIES_NUM_PIXELS - 1) / 2.0)   // the fit runs on t = (pixel - FIT_CENTER) / FIT_CENTER,
+                                                           // which keeps the basis within [-1, 1]
    
 /*===========================================================================
    EEPROM mapping
@@ -203,6 +207,8 @@
 #define MODUS_EXTERN_SINGLE_SHOT             2
 #define MODUS_EXTERN_CONTINUOUS              3
 
+#define CCS_SERIES_RECOVER_POLL              10       // ms between attempts to reopen a lost device
+
 #define CCS_SERIES_CALIB_VALID_FLAG          0x5A     // this is the value for check bytes
 #define CCS_SERIES_USERCAL_VALID_FLAG        0x5A     // user wavelenght adjustment data is valid
 
@@ -253,6 +259,11 @@ typedef struct
 } CCS_SERIES_version_t; 
 
 
+// scan processing kernel, see CCSseries_aquireRawScanData
+typedef void (*CCS_SERIES_proc_t)(const ViUInt16 raw[], const ViReal64 gain[], const ViReal64 dark[], const ViReal64 norm[], ViReal64 data[]);
+// same in fixed point, see CCSseries_aquireRawScanDataQ16
+typedef void (*CCS_SERIES_procQ16_t)(const ViUInt16 raw[], const ViUInt32 gain[], const int64_t dark[], const int64_t recip[], int64_t ndark, ViInt32 data[]);
+
 // driver private data
 typedef struct
 {
@@ -273,6 +284,7 @@ typedef struct
    
    // device settings
    ViReal64                   intTime;
+   ViUInt16                   scanMode;   // MODUS_* the device runs in, restored by CCSseries_recover
    ViUInt16                   evenOffsetMax;
    ViUInt16                   oddOffsetMax;
    
@@ -284,6 +296,50 @@ typedef struct
    CCS_SERIES_acor_t          factory_acor_cal;
    CCS_SERIES_acor_t          user_acor_cal;
    
+   // scan processing
+   ViInt32                    procMode;                          // CCS_SERIES_PROC_*
+   CCS_SERIES_proc_t          proc;                              // kernel of procMode
+   CCS_SERIES_procQ16_t       procQ16;                           // fixed point kernel of procMode
+   
+   // amplitude correction applied to scans
+   ViInt32                    acor_set;                          // ACOR_USE_FACTORY, ACOR_USE_USER or ACOR_USE_BOTH
+   ViReal64                   gain[CCS_SERIES_NUM_PIXELS];       // resulting per pixel factor
+   ViUInt32                   gain_q16[CCS_SERIES_NUM_PIXELS];   // same in Q16.16 for the fixed point path
+   ViBoolean                  gain_valid;                        // cleared whenever acor_set or an acor array changes
+   
+   // regions of interest
+   ViUInt32                   roi_cnt;
+   ViInt16                    roi_set;                              // calibration data set the windows refer to
+   ViReal64                   roi_lower[CCS_SERIES_MAX_ROIS];       // window limits in nm, kept to re-resolve
+   ViReal64                   roi_upper[CCS_SERIES_MAX_ROIS];       // the regions when that calibration changes
+   ViUInt32                   roi_first[CCS_SERIES_MAX_ROIS];       // first pixel of each region
+   ViUInt32                   roi_last[CCS_SERIES_MAX_ROIS];        // last pixel of each region
+   ViReal64                   roi_prefix[CCS_SERIES_NUM_PIXELS + 1]; // running sum over the last processed scan
+   
+   // burst capture
+   ViUInt16                   *burst_raw;                        // arrays given to CCSseries_startBurst
+   ViReal64                   *burst_data;
+   ViUInt32                   burst_processed;                   // scans of burst_raw already in burst_data
+   
+   // lost scans, see CCSseries_getDropStatistics
+   ViUInt32                   drop_scans;                        // scans read
+   ViUInt32                   drop_lost;                         // scans the device overwrote
+   ViUInt32                   drop_gaps;                         // gaps they fell into
+   ViUInt32                   drop_longest;                      // most scans lost in one gap
+   ViUInt32                   drop_discarded;                    // scans the read ahead dropped unread
+   ViUInt32                   drop_seen;                         // read ahead drop count of the USB session at the last scan
+   ViReal64                   drop_last;                         // arrival of the previous scan, 0 = none since the mode started
+   ViReal64                   drop_done;                         // when the device finished it, as far as known
+   ViReal64                   drop_iv[DROP_INTERVALS];           // newest intervals between arrivals, the period is their median
+   ViUInt32                   drop_niv;                          // intervals kept since the mode started
+   ViUInt32                   gap_head;                          // newest gap events, oldest at gap_head
+   ViUInt32                   gap_cnt;
+   ViReal64                   gap_time[CCS_SERIES_MAX_GAP_EVENTS];   // arrival of the scan after the gap
+   ViUInt32                   gap_lost[CCS_SERIES_MAX_GAP_EVENTS];   // scans lost in it
+   ViReal64                   scan_arrival;                      // arrival of the scan handed out last
+   ViUInt32                   scan_lost;                         // scans lost right before it, overwritten or dropped
+   ViReal64                   scan_intTime;                      // integration time it was taken with
+   
    // version
    CCS_SERIES_version_t       firmware_version;
    CCS_SERIES_version_t       hardware_version;
@@ -373,21 +429,39 @@ static uint16_t crc16_block(const void *dat, size_t len);
 static uint16_t crc16_update(uint16_t crc, uint8_t a);
 
 // analysis
-static int LeastSquareInterpolation (int * PixelArray, double * WaveLengthArray, int iLength, double Coefficients[]);  
-static double SpecSummation(double *pcorrel,int pwr,int values);
-static double Spec2Summation(double *pcorrel,int pwr,int values);
-static double Summation(double *pdata,int values);
-static void MergeMC(double s[MATRIX_ROWS][MATRIX_COLS],double i[MATRIX_ROWS],double d[MATRIX_ROWS][MATRIX_COLS],int column);
-static double Determinant(double mt[MATRIX_ROWS][MATRIX_COLS]);
+static int LeastSquareInterpolation (ViInt32 PixelArray[], ViReal64 WaveLengthArray[], int iLength, int order, ViReal64 Coefficients[]);
 
 // interpretes code as status and pops up an error screen if necessary, returns the code itself
 static ViStatus CCSseries_checkErrorLevel(ViSession instr, ViStatus code);
+static ViStatus CCSseries_startModus(ViSession instr, ViUInt16 modus);
+static void CCSseries_scanStopped(ViSession instr, ViInt16 bRequest);
+static void CCSseries_countDrops(ViSession instr);
 static ViStatus CCSseries_aquireRawScanData(ViSession instrumentHandle, ViUInt16 raw[], ViReal64 data[]);
+static ViStatus CCSseries_aquireRawScanDataQ16(ViSession instrumentHandle, ViUInt16 raw[], ViInt32 data[]);
+
+/*---------------------------------------------------------------------------
+ Processing kernels - one per processing mode, selected per handle by
+ CCSseries_setProcessingMode. Each gets the dark values and normalizing
+ factors of the even (index 0) and odd (index 1) pixels of the scan and
+ applies dark subtraction, normalization and amplitude correction in one
+ branch free pass. They are generated for the sensor geometry below with
+ fixed trip counts, see ccsgeom.h, as are their fixed point counterparts.
+ With a common dark value the result is below 1.0 exactly when the raw
+ value is below MAX_ADC_VALUE.
+---------------------------------------------------------------------------*/
+#define NO_DARK_PIXELS                 12       // we got 12 dark pixels
+#define DARK_PIXELS_OFFSET             16       // dark pixels start at positon 16 within raw data
+#define SCAN_PIXELS_OFFSET             32       // real measurement start at position 32 within raw data
+#define MAX_ADC_VALUE                  0xFFFF
+
+CCS_GEOM_KERNELS(CCSseries, CCS_SERIES_NUM_RAW_PIXELS, DARK_PIXELS_OFFSET, NO_DARK_PIXELS, SCAN_PIXELS_OFFSET, CCS_SERIES_NUM_PIXELS, MAX_ADC_VALUE, CCS_GEOM_FORWARD)
+
 static ViStatus CCSseries_getWavelengthParameters (ViSession instr);
 static ViStatus CCSseries_readEEFactoryPoly(ViSession instr, ViReal64 poly[]); 
 static ViStatus CCSseries_checkNodes(ViInt32 pixel[], ViReal64 wl[], ViInt32 cnt); 
 static ViStatus CCSseries_nodes2poly(ViInt32 pixel[], ViReal64 wl[], ViInt32 cnt, ViReal64 poly[]); 
 static ViStatus CCSseries_poly2wlArray(CCS_SERIES_wl_cal_t *wl);
+static ViStatus CCSseries_resolveROIs(CCS_SERIES_data_t *data, ViInt16 dataSet, ViUInt32 count, ViReal64 lower[], ViReal64 upper[]);
 
 static ViStatus CCSseries_readEEFactoryFlag(ViSession instr, ViPUInt16 flag);
 static ViStatus CCSseries_writeEEFactoryFlag(ViSession instr, ViUInt16 flag);
@@ -421,6 +495,9 @@ __declspec(dllexport) ViStatus CCSseries_readEEPROM(ViSession instr, ViUInt16 ad
 /*===========================================================================
  Global Variables
 ===========================================================================*/
+// resources found by CCSseries_findRsrc
+static ViChar     rsrcNames[CCS_SERIES_MAX_DEVICES][CCS_SERIES_BUFFER_SIZE];
+static ViUInt32   rsrcCount = 0;
 
 /*===========================================================================
 
@@ -440,6 +517,113 @@ __declspec(dllexport) ViStatus CCSseries_readEEPROM(ViSession instr, ViUInt16 ad
 
 ===========================================================================*/
 
+/*---------------------------------------------------------------------------
+   Function:   Find Resources
+   Purpose:    This function scans the USB once for all attached CCS series
+               spectrometers (every model in CCS_SERIES_FIND_PATTERN) and
+               keeps their resource names and serial numbers for
+               CCSseries_getRsrcName and CCSseries_getRsrcInfo. Resource
+               names have the form vid:pid:serial and select exactly that
+               unit in CCSseries_init; opening several units after one scan
+               does not walk the bus again.
+
+   Parameters:
+   
+   ViPUInt32 resourceCount:   Number of spectrometers found, at most
+                              CCS_SERIES_MAX_DEVICES.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_findRsrc (ViPUInt32 resourceCount)
+{
+   ViStatus       err;
+   ViSession      rm = VI_NULL;
+   ViFindList     findList;
+   ViUInt32       cnt = 0;
+   ViChar         rsrc[VI_FIND_BUFLEN];
+   
+   rsrcCount = 0;
+   if(resourceCount) *resourceCount = 0;
+   
+   if((err = viOpenDefaultRM(&rm))) return (err);
+   
+   err = viFindRsrc(rm, CCS_SERIES_FIND_PATTERN, &findList, &cnt, rsrc);
+   while((err == VI_SUCCESS) && (rsrcCount < CCS_SERIES_MAX_DEVICES))
+   {
+      snprintf(rsrcNames[rsrcCount], CCS_SERIES_BUFFER_SIZE, "%s", rsrc);
+      rsrcCount++;
+      err = viFindNext(findList, rsrc);
+   }
+   viClose(rm);
+   
+   // nothing (more) found is not an error here
+   if(err == VI_ERROR_RSRC_NFOUND) err = VI_SUCCESS;
+   
+   if(resourceCount) *resourceCount = rsrcCount;
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Resource Name
+   Purpose:    This function returns the resource name of a spectrometer
+               found by the last CCSseries_findRsrc, for CCSseries_init.
+
+   Parameters:
+   
+   ViUInt32 index:            0 ... resourceCount - 1.
+   ViChar resourceName[]:     The resource name (CCS_SERIES_BUFFER_SIZE).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getRsrcName (ViUInt32 index, ViChar _VI_FAR resourceName[])
+{
+   if(index >= rsrcCount)  return VI_ERROR_INV_PARAMETER;
+   if(!resourceName)       return VI_ERROR_INV_PARAMETER;
+   
+   strcpy(resourceName, rsrcNames[index]);
+   return VI_SUCCESS;
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Resource Information
+   Purpose:    This function returns model and serial number of a
+               spectrometer found by the last CCSseries_findRsrc.
+
+   Parameters:
+   
+   ViUInt32 index:            0 ... resourceCount - 1.
+   ViChar modelName[]:        The model name, e.g. "CCS175" (CCS_SERIES_BUFFER_SIZE),
+                              may be VI_NULL.
+   ViChar serialNumber[]:     The serial number (CCS_SERIES_BUFFER_SIZE), may be VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getRsrcInfo (ViUInt32 index, ViChar _VI_FAR modelName[], ViChar _VI_FAR serialNumber[])
+{
+   unsigned int   vid, pid;
+   int            n = 0;
+   
+   if(index >= rsrcCount)  return VI_ERROR_INV_PARAMETER;
+   
+   // resource names are vid:pid:serial
+   if(sscanf(rsrcNames[index], "%x:%x:%n", &vid, &pid, &n) < 2)   return VI_ERROR_INV_RESPONSE;
+   
+   if(serialNumber)
+   {
+      strcpy(serialNumber, n ? rsrcNames[index] + n : "");
+   }
+   if(modelName)
+   {
+      switch(pid)
+      {
+         case CCS100_PID:  strcpy(modelName, "CCS100");  break;
+         case CCS125_PID:  strcpy(modelName, "CCS125");  break;
+         case CCS150_PID:  strcpy(modelName, "CCS150");  break;
+         case CCS175_PID:  strcpy(modelName, "CCS175");  break;
+         case CCS200_PID:  strcpy(modelName, "CCS200");  break;
+         default:          strcpy(modelName, "");        break;
+      }
+   }
+   return VI_SUCCESS;
+}
+
+
 /*---------------------------------------------------------------------------
    Function:   Initialize
    Purpose:    This function initializes the instrument driver session and
@@ -482,9 +666,6 @@ ViStatus _VI_FUNC CCSseries_init (ViRsrc resourceName, ViBoolean IDQuery, ViBool
       (pid != CCS150_PID) && (pid != CCS175_PID) &&
       (pid != CCS200_PID))                                                          return (CCSseries_initClose(*pInstr, VI_ERROR_FAIL_ID_QUERY));
 
-   // Communication buffers
-   if((err = viFlush (*pInstr, VI_WRITE_BUF_DISCARD | VI_READ_BUF_DISCARD)))        return (CCSseries_initClose(*pInstr, err));
-
    // Configure Session
    if ((err = viSetAttribute(*pInstr, VI_ATTR_TMO_VALUE, CCS_SERIES_TIMEOUT_DEF)))  return (CCSseries_initClose(*pInstr, err));
 
@@ -499,6 +680,21 @@ ViStatus _VI_FUNC CCSseries_init (ViRsrc resourceName, ViBoolean IDQuery, ViBool
    data->pid      = pid;
    data->vid      = vid;
    data->timeout  = CCS_SERIES_TIMEOUT_DEF;
+   data->roi_cnt  = 0;
+   data->acor_set = ACOR_USE_FACTORY;
+   data->procMode = CCS_SERIES_PROC_COMMON;
+   data->proc     = CCSseries_procCommon;
+   data->procQ16  = CCSseries_q16Common;
+   data->gain_valid = VI_FALSE;
+   data->intTime  = CCS_SERIES_DEF_INT_TIME;
+   data->scanMode = MODUS_INTERN_SINGLE_SHOT;
+   data->burst_raw = VI_NULL;
+   data->burst_data = VI_NULL;
+   data->burst_processed = 0;
+   data->drop_seen = 0;
+   data->drop_last = 0.0;
+   data->drop_niv = 0;
+   CCSseries_resetDropStatistics(*pInstr);
 
    viGetAttribute(*pInstr, VI_ATTR_MODEL_NAME,     data->name);
    viGetAttribute(*pInstr, VI_ATTR_MANF_NAME,      data->manu);
@@ -508,7 +704,7 @@ ViStatus _VI_FUNC CCSseries_init (ViRsrc resourceName, ViBoolean IDQuery, ViBool
    viSetAttribute(*pInstr, VI_ATTR_USB_BULK_IN_PIPE,  0x86);  // verified, only othe possibility is 88
    viSetAttribute(*pInstr, VI_ATTR_USB_BULK_OUT_PIPE,  0x02); // not tested yet, could be 4
    
-   // Reset device
+   // Reset device, also discards the communication buffers
    if((err = viClear(*pInstr))) return (CCSseries_initClose(*pInstr, err));
 
    // Error query
@@ -552,6 +748,64 @@ ViStatus _VI_FUNC CCSseries_close (ViSession instr)
 }
 
 
+/*---------------------------------------------------------------------------
+   Function:   Recover
+   Purpose:    This function brings a session back after the spectrometer
+               was unplugged or reset, which makes every call fail with
+               VI_ERROR_CONN_LOST. It waits for the unit with the same
+               serial number to appear on the USB again and reopens it
+               under the same instrument handle. The integration time and,
+               except for a pending internal single shot, the scan mode are
+               restored; a mode that a later command already ended is not.
+               Calibration and amplitude correction are kept from
+               CCSseries_init and not read from the device again.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 timeout:          Time in ms to wait for the device to come back,
+                              0 tries once. VI_ERROR_RSRC_NFOUND if it did not.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_recover (ViSession instr, ViUInt32 timeout)
+{
+   ViStatus             err;
+   CCS_SERIES_data_t    *data;
+   struct timespec      pause = {0, CCS_SERIES_RECOVER_POLL * 1000000L};
+   ViUInt32             waited = 0;
+   ViUInt16             mode;
+   
+   if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   
+   // the device needs a moment to enumerate again
+   while((err = viReconnect(instr)) == VI_ERROR_RSRC_NFOUND)
+   {
+      if(waited >= timeout)   return err;
+      nanosleep(&pause, NULL);
+      waited += CCS_SERIES_RECOVER_POLL;
+   }
+   if(err)  return err;
+   
+   // restore what the device forgot, setting the integration time ends the mode
+   mode = data->scanMode;
+   if((err = CCSseries_setIntegrationTime(instr, data->intTime))) return err;
+   
+   switch(mode)
+   {
+      case MODUS_INTERN_CONTINUOUS:
+      case MODUS_EXTERN_SINGLE_SHOT:
+      case MODUS_EXTERN_CONTINUOUS:
+         err = CCSseries_startModus(instr, mode);
+         break;
+      
+      default:
+         // a lost internal single shot has to be started again by the caller
+         break;
+   }
+   
+   return err;
+}
+
+
 /*===========================================================================
 
 
@@ -562,6 +816,10 @@ ViStatus _VI_FUNC CCSseries_close (ViSession instr)
 /*---------------------------------------------------------------------------
    Function:   Set Integration Time
    Purpose:    This function set the optical integration time in seconds. 
+   
+               The device ends any scan mode with it, and scans still
+               buffered on the host are discarded since they were taken
+               with the old time. Start the scan mode again afterwards.
 
    Parameters:
    
@@ -574,6 +832,7 @@ ViStatus _VI_FUNC CCSseries_close (ViSession instr)
 ViStatus _VI_FUNC CCSseries_setIntegrationTime (ViSession instrumentHandle, ViReal64 integrationTime) 
 {
    ViStatus err = VI_SUCCESS;
+   CCS_SERIES_data_t *ccs_data = VI_NULL;
    ViUInt8  data[CCS_SERIES_NUM_INTEG_CTRL_BYTES];
    ViInt32 integ = 0;
    ViInt32 presc = 0;
@@ -614,10 +873,19 @@ ViStatus _VI_FUNC CCSseries_setIntegrationTime (ViSession instrumentHandle, ViRe
 
    // the transfer to device
    err = CCSseries_USB_out(instrumentHandle, CCS_SERIES_WCMD_INTEGRATION_TIME, 0, 0, CCS_SERIES_NUM_INTEG_CTRL_BYTES, (ViBuf)data);
+   
+   // what the read ahead holds was integrated with the old time
+   if(!err) err = viFlush(instrumentHandle, VI_READ_BUF_DISCARD);
 
    // error check and log
    err = CCSseries_checkErrorLevel(instrumentHandle, err);
    
+   // remember for CCSseries_recover
+   if(!err && !viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data) && ccs_data)
+   {
+      ccs_data->intTime = integrationTime;
+   }
+   
    return err; 
 }
 
@@ -684,7 +952,7 @@ ViStatus _VI_FUNC CCSseries_startScan (ViSession instrumentHandle)
 {
    ViStatus err = VI_SUCCESS;
    
-   err = CCSseries_USB_out(instrumentHandle, CCS_SERIES_WCMD_MODUS, MODUS_INTERN_SINGLE_SHOT, 0, 0, VI_NULL);
+   err = CCSseries_startModus(instrumentHandle, MODUS_INTERN_SINGLE_SHOT);
    
    // error check and log
    err = CCSseries_checkErrorLevel(instrumentHandle, err);
@@ -711,7 +979,7 @@ ViStatus _VI_FUNC CCSseries_startScanCont (ViSession instrumentHandle)
 {
    ViStatus err = VI_SUCCESS;
    
-   err = CCSseries_USB_out(instrumentHandle, CCS_SERIES_WCMD_MODUS, MODUS_INTERN_CONTINUOUS, 0, 0, VI_NULL);
+   err = CCSseries_startModus(instrumentHandle, MODUS_INTERN_CONTINUOUS);
 
    // error check and log
    err = CCSseries_checkErrorLevel(instrumentHandle, err);
@@ -739,7 +1007,7 @@ ViStatus _VI_FUNC CCSseries_startScanExtTrg (ViSession instrumentHandle)
 {
    ViStatus err = VI_SUCCESS;
    
-   err = CCSseries_USB_out(instrumentHandle, CCS_SERIES_WCMD_MODUS, MODUS_EXTERN_SINGLE_SHOT, 0, 0, VI_NULL);
+   err = CCSseries_startModus(instrumentHandle, MODUS_EXTERN_SINGLE_SHOT);
 
    // error check and log
    err = CCSseries_checkErrorLevel(instrumentHandle, err);
@@ -771,7 +1039,7 @@ ViStatus _VI_FUNC CCSseries_startScanContExtTrg (ViSession instrumentHandle)
 {
    ViStatus err = VI_SUCCESS;
    
-   err = CCSseries_USB_out(instrumentHandle, CCS_SERIES_WCMD_MODUS, MODUS_EXTERN_CONTINUOUS, 0, 0, VI_NULL);
+   err = CCSseries_startModus(instrumentHandle, MODUS_EXTERN_CONTINUOUS);
 
    // error check and log
    err = CCSseries_checkErrorLevel(instrumentHandle, err);
@@ -835,11 +1103,61 @@ ViStatus _VI_FUNC CCSseries_getDeviceStatus (ViSession instrumentHandle, ViPInt3
 ---------------------------------------------------------------------------*/
 ViStatus _VI_FUNC CCSseries_getScanData (ViSession instrumentHandle, ViReal64 _VI_FAR data[])
 {
-   ViStatus err         = VI_SUCCESS;     // error level
    ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];  // array to copy raw data to
    
-   // read raw scan data
-   if((err = CCSseries_getRawData(instrumentHandle, raw))) return err;
+   return (CCSseries_getScanDataAndRaw(instrumentHandle, raw, data));
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Try Get Scan Data
+   Purpose:    This function reads out the processed scan data like
+               CCSseries_getScanData, but never waits for the device. If no
+               complete scan is buffered yet it returns VI_SUCCESS_QUEUE_EMPTY
+               at once and leaves data untouched, so one thread can poll
+               several spectrometers.
+               The first call starts reading scans ahead in the background;
+               CCSseries_getScanData then also returns those buffered scans,
+               oldest first. A few scans are kept, older ones are dropped.
+               CCSseries_reset stops the read ahead and discards them.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViReal64 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_tryGetScanData (ViSession instrumentHandle, ViReal64 _VI_FAR data[])
+{
+   ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];  // array to copy raw data to
+   
+   return (CCSseries_tryGetScanDataAndRaw(instrumentHandle, raw, data));
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Try Get Scan Data And Raw
+   Purpose:    This function is CCSseries_tryGetScanData that also returns
+               the raw ADC values of the scan.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViUInt16 _VI_FAR raw[]:    The raw scan (CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViReal64 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_tryGetScanDataAndRaw (ViSession instrumentHandle, ViUInt16 _VI_FAR raw[], ViReal64 _VI_FAR data[])
+{
+   ViStatus err         = VI_SUCCESS;     // error level
+   ViUInt32 read_bytes  = 0;
+   
+   // take a buffered scan, if there is one
+   err = viTryRead(instrumentHandle, (ViBuf)raw, CCS_SERIES_NUM_RAW_PIXELS * sizeof(ViUInt16), &read_bytes);
+   if(err)  return (CCSseries_checkErrorLevel(instrumentHandle, err));
+   
+   // error mapping
+   if(read_bytes != CCS_SERIES_NUM_RAW_PIXELS * sizeof(ViUInt16))  return (CCSseries_checkErrorLevel(instrumentHandle, VI_ERROR_CCS_SERIES_READ_INCOMPLETE));
+   
+   CCSseries_countDrops(instrumentHandle);
    
    // process data
    err = CCSseries_aquireRawScanData(instrumentHandle, raw, data);
@@ -852,135 +1170,684 @@ ViStatus _VI_FUNC CCSseries_getScanData (ViSession instrumentHandle, ViReal64 _V
 
 
 /*---------------------------------------------------------------------------
-   Function:   Get Raw Scan Data
-   Purpose:    This function reads out the raw scan data. 
+   Function:   Get Scan Event File Descriptor
+   Purpose:    This function returns a file descriptor that becomes readable
+               when CCSseries_tryGetScanData has a scan (or an error) to
+               hand out, for use with poll, epoll or io_uring next to other
+               I/O. It starts reading scans ahead like
+               CCSseries_tryGetScanData does. Each CCSseries_tryGetScanData
+               that returns a scan or an error consumes one readiness count,
+               so level triggered polling works; do not read from the
+               descriptor yourself.
+               The descriptor stays valid until CCSseries_close and keeps
+               working across CCSseries_reset and CCSseries_recover.
 
    Parameters:
    
-   ViSession instr:                 The actual session to opened device.
-   ViReal64 _VI_FAR scanDataArray[]:The measurement array 
-                                    (CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViSession instr:           The actual session to opened device.
+   ViPInt32 fd:               The file descriptor.
 ---------------------------------------------------------------------------*/
-ViStatus _VI_FUNC CCSseries_getRawScanData (ViSession instrumentHandle, ViInt32 _VI_FAR scanDataArray[])
+ViStatus _VI_FUNC CCSseries_getScanEventFd (ViSession instrumentHandle, ViPInt32 fd)
 {
-   ViStatus err         = VI_SUCCESS;
-   ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];  // array to copy raw data to
-   ViInt32  i           = 0;
+   ViStatus err = VI_SUCCESS;
    
-   err = CCSseries_getRawData(instrumentHandle, raw);
+   if(!fd)  return VI_ERROR_INV_PARAMETER;
    
-   for(i = 0; i < CCS_SERIES_NUM_RAW_PIXELS; i++)
-   {
-      scanDataArray[i] = (ViInt32)raw[i];    
-   }
+   err = viGetReadEventFd(instrumentHandle, CCS_SERIES_NUM_RAW_PIXELS * sizeof(ViUInt16), fd);
    
-   // check for errors 
-   if((err = CCSseries_checkErrorLevel(instrumentHandle, err)))   return (err);  
+   // error check and log
+   err = CCSseries_checkErrorLevel(instrumentHandle, err);
    
    return (err);
 }
 
 
-
 /*---------------------------------------------------------------------------
-   Function:   Set Wavelength Data
-   Purpose:    This function stores data for user-defined pixel-wavelength
-               correlation to the instruments nonvolatile memory.
+   Function:   Get Scan Data And Raw
+   Purpose:    This function reads out one scan like CCSseries_getScanData
+               and returns the raw ADC values it was processed from as well.
 
-               The given data pair arrays are used to interpolate the
-               pixel-wavelength correlation array returned by the
-               CCSseries_getWavelengthData function.
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViUInt16 _VI_FAR raw[]:    The raw scan (CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViReal64 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanDataAndRaw (ViSession instrumentHandle, ViUInt16 _VI_FAR raw[], ViReal64 _VI_FAR data[])
+{
+   ViStatus err         = VI_SUCCESS;     // error level
+   
+   // read raw scan data
+   if((err = CCSseries_getRawData(instrumentHandle, raw))) return err;
+   
+   // process data
+   err = CCSseries_aquireRawScanData(instrumentHandle, raw, data);
+   
+   // error check and log
+   err = CCSseries_checkErrorLevel(instrumentHandle, err);
+   
+   return (err);
+}
 
-   Note: In case the interpolated pixel-wavelength correlation
-   contains negative values, or the values are not strictly
-   increasing the function returns with error VI_ERROR_INV_USER_DATA. 
+
+/*---------------------------------------------------------------------------
+   Function:   Start Burst
+   Purpose:    This function captures a burst of externally triggered scans
+               without losing any between triggers. It arms continuous
+               external triggering, discards what an earlier mode left in
+               the USB pipe and has a background thread keep a bulk read
+               posted, reading each scan straight into raw and recording
+               the host time it arrived. Triggers before this function
+               returns are not part of the burst.
+               Use CCSseries_waitBurst to wait for the scans and to get
+               them processed into data. The arrays have to stay valid until
+               the burst is complete or the session is cleared, reset,
+               recovered or closed, which ends the burst. Once complete,
+               further triggers are buffered for CCSseries_tryGetScanData
+               until another mode is started.
 
    Parameters:
    
-   ViSession instr:                       The actual session to opened device.
-   ViInt32 _VI_FAR pixelDataArray[]:      The pixel data. 
-   ViReal64 _VI_FAR wavelengthDataArray[]:The wavelength data.
-   ViInt32 bufferLength:                  The length of both arrays.
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 count:            The number of scans in the burst.
+   ViUInt16 _VI_FAR raw[]:    The raw scans
+                              (count * CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViReal64 _VI_FAR data[]:   The processed scans
+                              (count * CCS_SERIES_NUM_PIXELS elements),
+                              VI_NULL for raw scans only.
+   ViReal64 _VI_FAR timestamps[]: The arrival time of each scan in seconds
+                              on CLOCK_MONOTONIC (count elements), may be
+                              VI_NULL.
 ---------------------------------------------------------------------------*/
-ViStatus _VI_FUNC CCSseries_setWavelengthData (ViSession instrumentHandle, ViInt32 _VI_FAR pixelDataArray[], ViReal64 _VI_FAR wavelengthDataArray[], ViInt32 bufferLength)
+ViStatus _VI_FUNC CCSseries_startBurst (ViSession instrumentHandle, ViUInt32 count, ViUInt16 _VI_FAR raw[], ViReal64 _VI_FAR data[], ViReal64 _VI_FAR timestamps[])
 {
-#define FACTORY_ADJ_OFFSET       62749006
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err         = VI_SUCCESS;     // error level
    
-   ViStatus err      = VI_SUCCESS;
-   CCS_SERIES_data_t       *data;
-   CCS_SERIES_wl_cal_t  cal;
-   char              target = 0;
+   if(!count || !raw)  return VI_ERROR_INV_PARAMETER;
    
    // get private data
-   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
-   
-   if((!pixelDataArray) || (!wavelengthDataArray)) return VI_ERROR_INV_PARAMETER; 
-   
-   // check valid buffer length and determine target
-   if((bufferLength >= CCS_SERIES_MIN_NUM_USR_ADJ) && (bufferLength <= CCS_SERIES_MAX_NUM_USR_ADJ))
-   {
-      target = 1; // target is user adjustment data
-   }
-   else if ((bufferLength >= (CCS_SERIES_MIN_NUM_USR_ADJ + FACTORY_ADJ_OFFSET)) && (bufferLength <= (CCS_SERIES_MAX_NUM_USR_ADJ  + FACTORY_ADJ_OFFSET)))
-   {
-      bufferLength -= FACTORY_ADJ_OFFSET;
-      target = 0; // target is factory adjustment data
-   }
-   else return VI_ERROR_INV_PARAMETER;
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
    
-   // check nodes array
-   if((err = CCSseries_checkNodes(pixelDataArray, wavelengthDataArray, bufferLength)) != VI_SUCCESS)  return err;
+   // arm first: from here on scans only come with a trigger ...
+   if((err = CCSseries_startModus(instrumentHandle, MODUS_EXTERN_CONTINUOUS)))  return (CCSseries_checkErrorLevel(instrumentHandle, err));
    
-   // calculate new coefficients...
-   if((err = CCSseries_nodes2poly(pixelDataArray, wavelengthDataArray, bufferLength, cal.poly)) != VI_SUCCESS) return err;
+   // ... so whatever is still in the pipe is from before
+   if((err = viFlush(instrumentHandle, VI_READ_BUF_DISCARD)))  return (CCSseries_checkErrorLevel(instrumentHandle, err));
    
-   // use the coefficients to calculate the new wavelength array...
-   if((err = CCSseries_poly2wlArray(&cal)) != VI_SUCCESS)   return err;
+   ccs_data->burst_raw       = raw;
+   ccs_data->burst_data      = data;
+   ccs_data->burst_processed = 0;
    
+   err = viStartBurst(instrumentHandle, (ViBuf)raw, CCS_SERIES_NUM_RAW_PIXELS * sizeof(ViUInt16), count, timestamps);
    
-   // write new data to EEPROM and data structure
-   if(target)
-   {
-      ////  target is user adjustment data  ////
-      
-      // write polynomical coefficients to eeprom
-      if((err = CCSseries_writeEEUserPoly(instrumentHandle, cal.poly)) != VI_SUCCESS) return err;
-      
-      // write user  calibration points
-      if((err = CCSseries_writeEEUserPoints(instrumentHandle, pixelDataArray, wavelengthDataArray, bufferLength)) != VI_SUCCESS) return err;
-
-      // write valid flags to eeprom
-      cal.valid = 1;
-      if((err = CCSseries_writeEEUserFlag(instrumentHandle, cal.valid)) != VI_SUCCESS) return err;
-      
-      // copy new values
-      memcpy(&(data->user_cal), &cal, sizeof(CCS_SERIES_wl_cal_t));
-       
-      memcpy(data->user_points.user_cal_node_pixel, pixelDataArray, sizeof(ViUInt32) * bufferLength);
-      memcpy(data->user_points.user_cal_node_wl, wavelengthDataArray, sizeof(ViReal64) * bufferLength);
-      data->user_points.user_cal_node_cnt = bufferLength;
-   }
-   else
-   {
-      ////  target is factory adjustment data   ////
-      
-      // write polynomical coefficients to eeprom
-      if((err = CCSseries_writeEEFactoryPoly(instrumentHandle, cal.poly)) != VI_SUCCESS) return err;
-      
-      // write valid flags to eeprom
-      cal.valid = 1;
-      if((err = CCSseries_writeEEFactoryFlag(instrumentHandle, cal.valid)) != VI_SUCCESS) return err;
-      
-      // copy new values to CCS data
-      memcpy(&(data->factory_cal), &cal, sizeof(CCS_SERIES_wl_cal_t));
-   }
+   // error check and log
+   err = CCSseries_checkErrorLevel(instrumentHandle, err);
    
-   return err;
+   return (err);
 }
 
 
 /*---------------------------------------------------------------------------
-   Function:   Get Wavelength Data
+   Function:   Wait Burst
+   Purpose:    This function waits for the burst started with
+               CCSseries_startBurst to complete and processes the scans
+               that arrived since the last call into the data array.
+               While the burst is incomplete after the timeout it returns
+               VI_ERROR_TMO and the capture goes on, so it can be called
+               repeatedly to work on a burst as it comes in. An error that
+               ended the burst early is returned with the number of scans
+               captured before it.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 timeout:          Time in ms to wait, 0 only looks.
+   ViPUInt32 captured:        The number of scans captured so far, may be
+                              VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_waitBurst (ViSession instrumentHandle, ViUInt32 timeout, ViPUInt32 captured)
+{
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err         = VI_SUCCESS;     // error level
+   ViStatus perr        = VI_SUCCESS;
+   ViUInt32 done        = 0;
+   ViUInt32 i;
+   
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
+   
+   err = viWaitBurst(instrumentHandle, timeout, &done);
+   
+   // process here rather than in the reader, which has to be back at the pipe at once
+   if(ccs_data->burst_data)
+   {
+      for(i = ccs_data->burst_processed; (i < done) && !perr; i++)
+      {
+         perr = CCSseries_aquireRawScanData(instrumentHandle, ccs_data->burst_raw + i * CCS_SERIES_NUM_RAW_PIXELS, ccs_data->burst_data + i * CCS_SERIES_NUM_PIXELS);
+      }
+   }
+   ccs_data->burst_processed = done;
+   
+   if(captured)  *captured = done;
+   
+   // error check and log
+   err = CCSseries_checkErrorLevel(instrumentHandle, err ? err : perr);
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Drop Statistics
+   Purpose:    This function tells how many scans were lost since
+               CCSseries_init or CCSseries_resetDropStatistics because they
+               were not read in time, to size buffers and thread priorities
+               by. Two kinds of loss are counted:
+               In internal continuous mode (CCSseries_startScanCont) the
+               device overwrites a scan that was not transferred before the
+               next one is done. These are inferred from when the scans
+               arrived at the host: k scan periods between the completion
+               of one scan and the arrival of the next mean k - 1 lost.
+               The period is the median of the last few intervals between
+               arrivals, at least the integration time, so one late read
+               does not make later scans look lost, and gaps in the first
+               few scans after the start go unnoticed.
+               Scans the read ahead of CCSseries_tryGetScanData received
+               but dropped because its queue was full are counted exactly,
+               in every mode.
+               Every output may be VI_NULL.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViPUInt32 scans:           The number of scans read.
+   ViPUInt32 dropped:         The number of scans the device overwrote.
+   ViPUInt32 gaps:            The number of gaps the overwritten scans fell
+                              into, see CCSseries_getGapEvents.
+   ViPUInt32 longestGap:      The most scans overwritten in one gap.
+   ViPUInt32 discarded:       The number of scans the read ahead dropped.
+   ViPReal64 overrun:         The fraction of all scans lost either way,
+                              0 to 1.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getDropStatistics (ViSession instrumentHandle, ViPUInt32 scans, ViPUInt32 dropped, ViPUInt32 gaps, ViPUInt32 longestGap, ViPUInt32 discarded, ViPReal64 overrun)
+{
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err         = VI_SUCCESS;     // error level
+   ViReal64 total;
+   
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
+   
+   total = (ViReal64)ccs_data->drop_scans + ccs_data->drop_lost + ccs_data->drop_discarded;
+   
+   if(scans)      *scans      = ccs_data->drop_scans;
+   if(dropped)    *dropped    = ccs_data->drop_lost;
+   if(gaps)       *gaps       = ccs_data->drop_gaps;
+   if(longestGap) *longestGap = ccs_data->drop_longest;
+   if(discarded)  *discarded  = ccs_data->drop_discarded;
+   if(overrun)    *overrun    = (total > 0.0) ? (ccs_data->drop_lost + ccs_data->drop_discarded) / total : 0.0;
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Gap Events
+   Purpose:    This function hands out the gaps CCSseries_getDropStatistics
+               counted, oldest first, and forgets them. Only the newest
+               CCS_SERIES_MAX_GAP_EVENTS are kept.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 maxCount:         The size of the arrays.
+   ViReal64 _VI_FAR timestamps[]: The arrival of the first scan after each
+                              gap in seconds on CLOCK_MONOTONIC, may be
+                              VI_NULL.
+   ViUInt32 _VI_FAR lost[]:   The number of scans lost in each gap, may be
+                              VI_NULL.
+   ViPUInt32 count:           The number of gaps returned.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getGapEvents (ViSession instrumentHandle, ViUInt32 maxCount, ViReal64 _VI_FAR timestamps[], ViUInt32 _VI_FAR lost[], ViPUInt32 count)
+{
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err         = VI_SUCCESS;     // error level
+   ViUInt32 n           = 0;
+   
+   if(!count)  return VI_ERROR_INV_PARAMETER;
+   
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
+   
+   for(n = 0; (n < maxCount) && ccs_data->gap_cnt; n++)
+   {
+      if(timestamps) timestamps[n] = ccs_data->gap_time[ccs_data->gap_head];
+      if(lost)       lost[n]       = ccs_data->gap_lost[ccs_data->gap_head];
+      ccs_data->gap_head = (ccs_data->gap_head + 1) % CCS_SERIES_MAX_GAP_EVENTS;
+      ccs_data->gap_cnt--;
+   }
+   *count = n;
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Reset Drop Statistics
+   Purpose:    This function sets the counts of CCSseries_getDropStatistics
+               to zero and forgets the gap events.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_resetDropStatistics (ViSession instrumentHandle)
+{
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err         = VI_SUCCESS;     // error level
+   
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
+   
+   ccs_data->drop_scans     = 0;
+   ccs_data->drop_lost      = 0;
+   ccs_data->drop_gaps      = 0;
+   ccs_data->drop_longest   = 0;
+   ccs_data->drop_discarded = 0;
+   ccs_data->gap_head       = 0;
+   ccs_data->gap_cnt        = 0;
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Info
+   Purpose:    This function tells when the scan handed out last arrived at
+               the host and how many scans were lost right before it, in
+               the sense of CCSseries_getDropStatistics. Numbering scans by
+               one plus the lost ones each keeps the numbers in step with
+               the device. It also tells the integration time the scan was
+               taken with.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViPReal64 arrival:         The arrival in seconds on CLOCK_MONOTONIC,
+                              may be VI_NULL.
+   ViPUInt32 lost:            The number of scans the device overwrote or
+                              the read ahead dropped since the scan before,
+                              may be VI_NULL.
+   ViPReal64 integrationTime: The integration time of the scan in seconds,
+                              may be VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanInfo (ViSession instrumentHandle, ViPReal64 arrival, ViPUInt32 lost, ViPReal64 integrationTime)
+{
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err         = VI_SUCCESS;     // error level
+   
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
+   
+   if(arrival)    *arrival    = ccs_data->scan_arrival;
+   if(lost)       *lost       = ccs_data->scan_lost;
+   if(integrationTime)  *integrationTime = ccs_data->scan_intTime;
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Data Q16
+   Purpose:    This function reads out the processed scan data like
+               CCSseries_getScanData, computed in integer arithmetic.
+               Values are fixed point Q16.16: 0x10000 corresponds to 1.0.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViInt32 _VI_FAR data[]:    The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanDataQ16 (ViSession instrumentHandle, ViInt32 _VI_FAR data[])
+{
+   ViStatus err         = VI_SUCCESS;     // error level
+   ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];  // array to copy raw data to
+   
+   // read raw scan data
+   if((err = CCSseries_getRawData(instrumentHandle, raw))) return err;
+   
+   // process data
+   err = CCSseries_aquireRawScanDataQ16(instrumentHandle, raw, data);
+   
+   // error check and log
+   err = CCSseries_checkErrorLevel(instrumentHandle, err);
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Data U16
+   Purpose:    This function reads out the processed scan data like
+               CCSseries_getScanData, computed in integer arithmetic and
+               scaled so that 0xFFFF corresponds to 1.0. Values outside
+               0.0 ... 1.0 are clipped.
+
+   Parameters:
+   
+   ViSession instr:           The actual session to opened device.
+   ViUInt16 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanDataU16 (ViSession instrumentHandle, ViUInt16 _VI_FAR data[])
+{
+   ViStatus err         = VI_SUCCESS;     // error level
+   ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];  // array to copy raw data to
+   ViInt32  q16[CCS_SERIES_NUM_PIXELS];
+   ViInt32  v;
+   int      i;
+   
+   // read raw scan data
+   if((err = CCSseries_getRawData(instrumentHandle, raw))) return err;
+   
+   // process data
+   if(!(err = CCSseries_aquireRawScanDataQ16(instrumentHandle, raw, q16)))
+   {
+      for(i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
+      {
+         // x * 0xFFFF / 0x10000 == x - x / 0x10000
+         v = q16[i] - (q16[i] >> 16);
+         v = (v < 0) ? 0 : v;
+         data[i] = (ViUInt16)((v > 0xFFFF) ? 0xFFFF : v);
+      }
+   }
+   
+   // error check and log
+   err = CCSseries_checkErrorLevel(instrumentHandle, err);
+   
+   return (err);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Raw Scan Data
+   Purpose:    This function reads out the raw scan data. 
+
+   Parameters:
+   
+   ViSession instr:                 The actual session to opened device.
+   ViReal64 _VI_FAR scanDataArray[]:The measurement array 
+                                    (CCS_SERIES_NUM_RAW_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getRawScanData (ViSession instrumentHandle, ViInt32 _VI_FAR scanDataArray[])
+{
+   ViStatus err         = VI_SUCCESS;
+   ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];  // array to copy raw data to
+   ViInt32  i           = 0;
+   
+   err = CCSseries_getRawData(instrumentHandle, raw);
+   
+   for(i = 0; i < CCS_SERIES_NUM_RAW_PIXELS; i++)
+   {
+      scanDataArray[i] = (ViInt32)raw[i];    
+   }
+   
+   // check for errors 
+   if((err = CCSseries_checkErrorLevel(instrumentHandle, err)))   return (err);  
+   
+   return (err);
+}
+
+
+
+/*---------------------------------------------------------------------------
+   Function:   Set Regions Of Interest
+   Purpose:    This function registers wavelength windows that
+               CCSseries_getROIData reduces every scan to. A window covers
+               all pixels whose wavelength lies within [lower, upper] of
+               the given calibration data set. Pass count 0 to remove all
+               regions.
+   
+               The windows are kept in nm and resolved to pixel ranges
+               again whenever CCSseries_setWavelengthData changes the
+               calibration they refer to. If a window then holds no pixel
+               any more all regions are removed.
+
+   Parameters:
+   
+   ViSession instr:                       The actual session to opened device.
+   ViInt16 dataSet:                       Factory or user calibration.
+   ViUInt32 count:                        Number of windows, at most CCS_SERIES_MAX_ROIS.
+   ViReal64 _VI_FAR lowerWavelength[]:    Lower window limits in nm.
+   ViReal64 _VI_FAR upperWavelength[]:    Upper window limits in nm.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_setROIs (ViSession instrumentHandle, ViInt16 dataSet, ViUInt32 count, ViReal64 _VI_FAR lowerWavelength[], ViReal64 _VI_FAR upperWavelength[])
+{
+   CCS_SERIES_data_t    *data;
+   ViStatus       err = VI_SUCCESS;
+   
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   if(count > CCS_SERIES_MAX_ROIS) return VI_ERROR_INV_PARAMETER;
+   if(count && ((lowerWavelength == NULL) || (upperWavelength == NULL))) return VI_ERROR_INV_PARAMETER;
+   
+   return CCSseries_resolveROIs(data, dataSet, count, lowerWavelength, upperWavelength);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Resolve Regions Of Interest
+   Purpose:    This function turns wavelength windows into the pixel ranges
+               of the given calibration data set and registers them. On
+               error the registered regions stay untouched. The limits may
+               be the registered ones themselves.
+---------------------------------------------------------------------------*/
+static ViStatus CCSseries_resolveROIs(CCS_SERIES_data_t *data, ViInt16 dataSet, ViUInt32 count, ViReal64 lower[], ViReal64 upper[])
+{
+   CCS_SERIES_wl_cal_t  *cal;
+   ViUInt32       first[CCS_SERIES_MAX_ROIS], last[CCS_SERIES_MAX_ROIS];
+   ViUInt32       r;
+   int            i, lo, hi;
+   
+   switch (dataSet)
+   {
+      case CCS_SERIES_CAL_DATA_SET_FACTORY:
+         cal = &data->factory_cal;
+         break;
+         
+      case CCS_SERIES_CAL_DATA_SET_USER:
+         if(!data->user_cal.valid) return VI_ERROR_CCS_SERIES_NO_USER_DATA;
+         cal = &data->user_cal;
+         break;
+         
+      default:
+         return VI_ERROR_INV_PARAMETER;
+   }
+   
+   for(r = 0; r < count; r++)
+   {
+      // the axis may run either way, so collect the pixel range inside the window
+      lo = CCS_SERIES_NUM_PIXELS;
+      hi = -1;
+      for(i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
+      {
+         if((cal->wl[i] >= lower[r]) && (cal->wl[i] <= upper[r]))
+         {
+            if(i < lo)  lo = i;
+            hi = i;
+         }
+      }
+      if(hi < 0) return VI_ERROR_INV_PARAMETER;   // window holds no pixel
+      first[r] = lo;
+      last[r]  = hi;
+   }
+   
+   memmove(data->roi_lower, lower, count * sizeof(ViReal64));
+   memmove(data->roi_upper, upper, count * sizeof(ViReal64));
+   memcpy(data->roi_first, first, count * sizeof(ViUInt32));
+   memcpy(data->roi_last,  last,  count * sizeof(ViUInt32));
+   data->roi_set = dataSet;
+   data->roi_cnt = count;
+   
+   return VI_SUCCESS;
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get ROI Data
+   Purpose:    This function reads out one processed scan like
+               CCSseries_getScanData but returns only the sum, mean and
+               maximum of the scan data within each region registered with
+               CCSseries_setROIs. Sums and means come from the running sum
+               the scan processing keeps while regions are registered.
+
+   Note:
+   If you do not need some of the arrays you may pass NULL.
+
+   Parameters:
+   
+   ViSession instr:                       The actual session to opened device.
+   ViReal64 _VI_FAR sum[]:                Sum over each region (one element per region).
+   ViReal64 _VI_FAR mean[]:               Mean over each region.
+   ViReal64 _VI_FAR maximum[]:            Maximum within each region.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getROIData (ViSession instrumentHandle, ViReal64 _VI_FAR sum[], ViReal64 _VI_FAR mean[], ViReal64 _VI_FAR maximum[])
+{
+   CCS_SERIES_data_t    *data;
+   ViStatus       err = VI_SUCCESS;
+   ViReal64       scan[CCS_SERIES_NUM_PIXELS];
+   ViReal64       s, m;
+   ViUInt32       r, i;
+   
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   if(!data->roi_cnt) return VI_ERROR_INV_PARAMETER;
+   
+   if((err = CCSseries_getScanData(instrumentHandle, scan))) return err;
+   
+   for(r = 0; r < data->roi_cnt; r++)
+   {
+      s = data->roi_prefix[data->roi_last[r] + 1] - data->roi_prefix[data->roi_first[r]];
+      if(sum != NULL)   sum[r]  = s;
+      if(mean != NULL)  mean[r] = s / (ViReal64)(data->roi_last[r] - data->roi_first[r] + 1);
+      if(maximum != NULL)
+      {
+         m = scan[data->roi_first[r]];
+         for(i = data->roi_first[r] + 1; i <= data->roi_last[r]; i++)
+         {
+            if(scan[i] > m)   m = scan[i];
+         }
+         maximum[r] = m;
+      }
+   }
+   
+   return VI_SUCCESS;
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Set Wavelength Data
+   Purpose:    This function stores data for user-defined pixel-wavelength
+               correlation to the instruments nonvolatile memory.
+
+               The given data pair arrays are used to interpolate the
+               pixel-wavelength correlation array returned by the
+               CCSseries_getWavelengthData function.
+
+   Note: In case the interpolated pixel-wavelength correlation
+   contains negative values, or the values are not strictly
+   increasing the function returns with error VI_ERROR_INV_USER_DATA. 
+
+   Parameters:
+   
+   ViSession instr:                       The actual session to opened device.
+   ViInt32 _VI_FAR pixelDataArray[]:      The pixel data. 
+   ViReal64 _VI_FAR wavelengthDataArray[]:The wavelength data.
+   ViInt32 bufferLength:                  The length of both arrays.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_setWavelengthData (ViSession instrumentHandle, ViInt32 _VI_FAR pixelDataArray[], ViReal64 _VI_FAR wavelengthDataArray[], ViInt32 bufferLength)
+{
+#define FACTORY_ADJ_OFFSET       62749006
+   
+   ViStatus err      = VI_SUCCESS;
+   CCS_SERIES_data_t       *data;
+   CCS_SERIES_wl_cal_t  cal;
+   char              target = 0;
+   
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   
+   if((!pixelDataArray) || (!wavelengthDataArray)) return VI_ERROR_INV_PARAMETER; 
+   
+   // check valid buffer length and determine target
+   if((bufferLength >= CCS_SERIES_MIN_NUM_USR_ADJ) && (bufferLength <= CCS_SERIES_MAX_NUM_USR_ADJ))
+   {
+      target = 1; // target is user adjustment data
+   }
+   else if ((bufferLength >= (CCS_SERIES_MIN_NUM_USR_ADJ + FACTORY_ADJ_OFFSET)) && (bufferLength <= (CCS_SERIES_MAX_NUM_USR_ADJ  + FACTORY_ADJ_OFFSET)))
+   {
+      bufferLength -= FACTORY_ADJ_OFFSET;
+      target = 0; // target is factory adjustment data
+   }
+   else return VI_ERROR_INV_PARAMETER;
+   
+   // check nodes array
+   if((err = CCSseries_checkNodes(pixelDataArray, wavelengthDataArray, bufferLength)) != VI_SUCCESS)  return err;
+   
+   // calculate new coefficients...
+   if((err = CCSseries_nodes2poly(pixelDataArray, wavelengthDataArray, bufferLength, cal.poly)) != VI_SUCCESS) return err;
+   
+   // use the coefficients to calculate the new wavelength array...
+   if((err = CCSseries_poly2wlArray(&cal)) != VI_SUCCESS)   return err;
+   
+   
+   // write new data to EEPROM and data structure
+   if(target)
+   {
+      ////  target is user adjustment data  ////
+      
+      // write polynomical coefficients to eeprom
+      if((err = CCSseries_writeEEUserPoly(instrumentHandle, cal.poly)) != VI_SUCCESS) return err;
+      
+      // write user  calibration points
+      if((err = CCSseries_writeEEUserPoints(instrumentHandle, pixelDataArray, wavelengthDataArray, bufferLength)) != VI_SUCCESS) return err;
+
+      // write valid flags to eeprom
+      cal.valid = 1;
+      if((err = CCSseries_writeEEUserFlag(instrumentHandle, cal.valid)) != VI_SUCCESS) return err;
+      
+      // copy new values
+      memcpy(&(data->user_cal), &cal, sizeof(CCS_SERIES_wl_cal_t));
+       
+      memcpy(data->user_points.user_cal_node_pixel, pixelDataArray, sizeof(ViUInt32) * bufferLength);
+      memcpy(data->user_points.user_cal_node_wl, wavelengthDataArray, sizeof(ViReal64) * bufferLength);
+      data->user_points.user_cal_node_cnt = bufferLength;
+   }
+   else
+   {
+      ////  target is factory adjustment data   ////
+      
+      // write polynomical coefficients to eeprom
+      if((err = CCSseries_writeEEFactoryPoly(instrumentHandle, cal.poly)) != VI_SUCCESS) return err;
+      
+      // write valid flags to eeprom
+      cal.valid = 1;
+      if((err = CCSseries_writeEEFactoryFlag(instrumentHandle, cal.valid)) != VI_SUCCESS) return err;
+      
+      // copy new values to CCS data
+      memcpy(&(data->factory_cal), &cal, sizeof(CCS_SERIES_wl_cal_t));
+   }
+   
+   // the regions have to follow the calibration they were given in
+   if(data->roi_cnt && (data->roi_set == (target ? CCS_SERIES_CAL_DATA_SET_USER : CCS_SERIES_CAL_DATA_SET_FACTORY)))
+   {
+      if(CCSseries_resolveROIs(data, data->roi_set, data->roi_cnt, data->roi_lower, data->roi_upper) != VI_SUCCESS) data->roi_cnt = 0;
+   }
+   
+   return err;
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Wavelength Data
    Purpose:    This function returns data for the pixel-wavelength correlation.
                The maximum and the minimum wavelength are additionally provided
                in two separate return values.
@@ -1037,6 +1904,71 @@ ViStatus _VI_FUNC CCSseries_getWavelengthData (ViSession instrumentHandle, ViInt
 }
 
 
+/*---------------------------------------------------------------------------
+   Function:   Get Wavelength Polynomial
+   Purpose:    This function returns the coefficients of the polynomial
+               the wavelength data array is computed from:
+               wl(pixel) = poly[0] + poly[1]*pixel + poly[2]*pixel^2 + poly[3]*pixel^3
+
+   Parameters:
+   
+   ViSession instr:                       The actual session to opened device.
+   ViInt16 dataSet:                       Factory or user calibration. 
+   ViReal64 _VI_FAR poly[]:               The coefficients (CCS_SERIES_NUM_POLY_POINTS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getWavelengthPoly (ViSession instrumentHandle, ViInt16 dataSet, ViReal64 _VI_FAR poly[])
+{
+   CCS_SERIES_data_t    *data;
+   ViStatus       err = VI_SUCCESS;
+   
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;    
+   if(poly == NULL) return VI_ERROR_INV_PARAMETER;
+   
+   switch (dataSet)
+   {
+      case CCS_SERIES_CAL_DATA_SET_FACTORY:
+         memcpy(poly, data->factory_cal.poly, (CCS_SERIES_NUM_POLY_POINTS * sizeof(ViReal64)));
+         break;
+         
+      case CCS_SERIES_CAL_DATA_SET_USER:
+         if(!data->user_cal.valid) return VI_ERROR_CCS_SERIES_NO_USER_DATA;
+         memcpy(poly, data->user_cal.poly, (CCS_SERIES_NUM_POLY_POINTS * sizeof(ViReal64)));
+         break;
+         
+      default:
+         return VI_ERROR_INV_PARAMETER;
+   }
+
+   return VI_SUCCESS;
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Fit Polynomial
+   Purpose:    This function fits a polynomial of the given order through
+               pixel-wavelength supporting points in the least squares
+               sense, the way the driver computes the user calibration
+               (which is of order 3) in CCSseries_setWavelengthData. It does
+               not change any calibration of the instrument.
+
+   Parameters:
+   
+   ViInt32 _VI_FAR pixelDataArray[]:      The pixel numbers of the supporting points.
+   ViReal64 _VI_FAR wavelengthDataArray[]:Their wavelengths.
+   ViInt32 bufferLength:                  The number of supporting points, at least order + 1.
+   ViInt32 order:                         1 ... CCS_SERIES_MAX_FIT_ORDER.
+   ViReal64 _VI_FAR poly[]:               The order + 1 coefficients, lowest power first.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_fitPolynomial (ViInt32 _VI_FAR pixelDataArray[], ViReal64 _VI_FAR wavelengthDataArray[], ViInt32 bufferLength, ViInt32 order, ViReal64 _VI_FAR poly[])
+{
+   if((pixelDataArray == NULL) || (wavelengthDataArray == NULL) || (poly == NULL))  return VI_ERROR_INV_PARAMETER;
+   if((order < 1) || (order > CCS_SERIES_MAX_FIT_ORDER))                             return VI_ERROR_INV_PARAMETER;
+   
+   if(LeastSquareInterpolation (pixelDataArray, wavelengthDataArray, (int)bufferLength, (int)order, poly)) return VI_ERROR_CCS_SERIES_INV_USER_DATA;
+   return VI_SUCCESS;
+}
+
+
 /*---------------------------------------------------------------------------
    Function:   Get User Calibration Points
    Purpose:    This function returns the user-defined pixel-wavelength
@@ -1161,6 +2093,7 @@ ViStatus _VI_FUNC CCSseries_setAmplitudeData (ViSession instr, ViReal64 AmpCorrF
       {
          data->user_acor_cal.acor[bufferStart + i] = (float)AmpCorrFact[i];
       }
+      data->gain_valid = VI_FALSE;
 
       // .. eventually copy them to NVMEM (EEPROM) too
       if(mode == ACOR_APPLY_TO_MEAS_NVMEM)
@@ -1175,6 +2108,7 @@ ViStatus _VI_FUNC CCSseries_setAmplitudeData (ViSession instr, ViReal64 AmpCorrF
       {
          data->factory_acor_cal.acor[bufferStart + i] = (float)AmpCorrFact[i];
       }
+      data->gain_valid = VI_FALSE;
 
       // .. eventually copy them to NVMEM (EEPROM) too
       if(mode == ACOR_APPLY_TO_MEAS_NVMEM)
@@ -1251,63 +2185,219 @@ ViStatus _VI_FUNC CCSseries_getAmplitudeData (ViSession instr, ViReal64 AmpCorrF
    {
       ////  target is user adjustment data  ////
 
-      if(mode == ACOR_FROM_NVMEM)
-      {
+      if(mode == ACOR_FROM_NVMEM)
+      {
+
+         // request the data for user amplitude factors
+         data->gain_valid = VI_FALSE;
+         err = CCSseries_readEEPROM(instr, EE_ACOR_USER,    0, EE_LENGTH_ACOR, (ViBuf)data->user_acor_cal.acor, &read_bytes);
+   
+         // error mapping
+         if((read_bytes != EE_LENGTH_ACOR) && (!err))   err = VI_ERROR_CCS_SERIES_READ_INCOMPLETE; 
+
+         // when checksum failed but everything else was ok -> assume a blank or new device, generate an array of 1.000 and write it to the EEPROM
+         if(err == VI_ERROR_CYEEPROM_CHKSUM)
+         {
+            for(i=0; i<CCS_SERIES_NUM_PIXELS; i++)
+            {
+               data->user_acor_cal.acor[i] = 1.0;
+            }
+            err = CCSseries_writeEEPROM(instr, EE_ACOR_USER, 0, EE_LENGTH_ACOR, (ViBuf)data->user_acor_cal.acor);
+         }
+      }
+      
+      // copy new values
+      for(i=0; i<bufferLength; i++)
+      {
+         AmpCorrFact[i] = (ViReal64)data->user_acor_cal.acor[i + bufferStart];
+      }
+       
+   }
+   else
+   {
+      ////  target is factory adjustment data   ////
+      
+      if(mode == ACOR_FROM_NVMEM)
+      {
+         // request the data for factory amplitude factors
+         data->gain_valid = VI_FALSE;
+         err = CCSseries_readEEPROM(instr, EE_ACOR_FACTORY, 0, EE_LENGTH_ACOR, (ViBuf)data->factory_acor_cal.acor, &read_bytes);
+   
+         // error mapping
+         if((read_bytes != EE_LENGTH_ACOR) && (!err))   err = VI_ERROR_CCS_SERIES_READ_INCOMPLETE; 
+
+         // when checksum failed but everything else was ok -> assume a blank or new device, generate an array of 1.000 and write it to the EEPROM
+         if(err == VI_ERROR_CYEEPROM_CHKSUM)
+         {
+            for(i=0; i<CCS_SERIES_NUM_PIXELS; i++)
+            {
+               data->factory_acor_cal.acor[i] = 1.0;
+            }
+            err = CCSseries_writeEEPROM(instr, EE_ACOR_FACTORY, 0, EE_LENGTH_ACOR, (ViBuf)data->factory_acor_cal.acor);
+         }
+      }
+      
+      // copy new values
+      for(i=0; i<bufferLength; i++)
+      {
+         AmpCorrFact[i] = (ViReal64)data->factory_acor_cal.acor[i + bufferStart];
+      }
+   }
+    
+   return VI_SUCCESS;
+}
+
+
+
+/*---------------------------------------------------------------------------
+   Function:   Set Amplitude Correction Set
+   Purpose:    This function selects which amplitude correction factors are
+               applied to the scan data: the factory set (default), the
+               user set, or the product of both.
+               The resulting factors are computed once when the selection
+               or a set changes, not per scan.
+
+   Parameters:
+   
+   ViSession instr:                 The actual session to opened device.
+   ViInt32 set:                     ACOR_USE_FACTORY, ACOR_USE_USER or ACOR_USE_BOTH.
+                                    Other values return VI_ERROR_INV_PARAMETER.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_setAmplitudeCorrectionSet (ViSession instr, ViInt32 set)
+{
+   ViStatus             err      = VI_SUCCESS;
+   CCS_SERIES_data_t    *data;
+   
+   // get private data
+   if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   
+   switch(set)
+   {
+      case ACOR_USE_FACTORY:
+      case ACOR_USE_USER:
+      case ACOR_USE_BOTH:
+            break;
+      default:
+            return VI_ERROR_INV_PARAMETER;
+   }
+   
+   if(set != data->acor_set)
+   {
+      data->acor_set   = set;
+      data->gain_valid = VI_FALSE;
+   }
+   
+   return VI_SUCCESS;
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Amplitude Correction Set
+   Purpose:    This function returns the amplitude correction set applied
+               to the scan data.
+
+   Parameters:
+   
+   ViSession instr:                 The actual session to opened device.
+   ViPInt32 set:                    ACOR_USE_FACTORY, ACOR_USE_USER or ACOR_USE_BOTH.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getAmplitudeCorrectionSet (ViSession instr, ViPInt32 set)
+{
+   ViStatus             err      = VI_SUCCESS;
+   CCS_SERIES_data_t    *data;
+   
+   if(set == VI_NULL) return VI_ERROR_INV_PARAMETER;
+   
+   // get private data
+   if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   
+   *set = data->acor_set;
+   
+   return VI_SUCCESS;
+}
+
+
+
+/*---------------------------------------------------------------------------
+   Function:   Set Processing Mode
+   Purpose:    This function selects how the dark pixels of each scan are
+               applied to the data returned by CCSseries_getScanData and
+               the other processed scan functions.
+
+               CCS_SERIES_PROC_COMMON (default): one dark value, the
+               average of all dark pixels. Saturated pixels are not
+               amplitude corrected.
+               CCS_SERIES_PROC_EVEN_ODD: separate dark values for even
+               and odd pixels, normalized to the larger one.
+               CCS_SERIES_PROC_CLAMPED: separate dark values for even and
+               odd pixels, each limited to the dark current offset maximum
+               stored in the device and normalized on its own; values
+               below zero are clipped (processing of the SPx driver).
+
+   Parameters:
+   
+   ViSession instr:                 The actual session to opened device.
+   ViInt32 mode:                    One of the modes above. Other values
+                                    return VI_ERROR_INV_PARAMETER.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_setProcessingMode (ViSession instr, ViInt32 mode)
+{
+   ViStatus             err      = VI_SUCCESS;
+   CCS_SERIES_data_t    *data;
+   CCS_SERIES_proc_t    proc;
+   CCS_SERIES_procQ16_t procQ16;
+   
+   // get private data
+   if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   
+   switch(mode)
+   {
+      case CCS_SERIES_PROC_COMMON:
+            proc = CCSseries_procCommon;
+            procQ16 = CCSseries_q16Common;
+            break;
+      case CCS_SERIES_PROC_EVEN_ODD:
+            proc = CCSseries_procEvenOdd;
+            procQ16 = CCSseries_q16EvenOdd;
+            break;
+      case CCS_SERIES_PROC_CLAMPED:
+            proc = CCSseries_procClamped;
+            procQ16 = CCSseries_q16Clamped;
+            break;
+      default:
+            return VI_ERROR_INV_PARAMETER;
+   }
+   
+   data->procMode = mode;
+   data->proc     = proc;
+   data->procQ16  = procQ16;
+   
+   return VI_SUCCESS;
+}
+
 
-         // request the data for user amplitude factors
-         err = CCSseries_readEEPROM(instr, EE_ACOR_USER,    0, EE_LENGTH_ACOR, (ViBuf)data->user_acor_cal.acor, &read_bytes);
-   
-         // error mapping
-         if((read_bytes != EE_LENGTH_ACOR) && (!err))   err = VI_ERROR_CCS_SERIES_READ_INCOMPLETE; 
+/*---------------------------------------------------------------------------
+   Function:   Get Processing Mode
+   Purpose:    This function returns the processing mode of the session.
 
-         // when checksum failed but everything else was ok -> assume a blank or new device, generate an array of 1.000 and write it to the EEPROM
-         if(err == VI_ERROR_CYEEPROM_CHKSUM)
-         {
-            for(i=0; i<CCS_SERIES_NUM_PIXELS; i++)
-            {
-               data->user_acor_cal.acor[i] = 1.0;
-            }
-            err = CCSseries_writeEEPROM(instr, EE_ACOR_USER, 0, EE_LENGTH_ACOR, (ViBuf)data->user_acor_cal.acor);
-         }
-      }
-      
-      // copy new values
-      for(i=0; i<bufferLength; i++)
-      {
-         AmpCorrFact[i] = (ViReal64)data->user_acor_cal.acor[i + bufferStart];
-      }
-       
-   }
-   else
-   {
-      ////  target is factory adjustment data   ////
-      
-      if(mode == ACOR_FROM_NVMEM)
-      {
-         // request the data for factory amplitude factors
-         err = CCSseries_readEEPROM(instr, EE_ACOR_FACTORY, 0, EE_LENGTH_ACOR, (ViBuf)data->factory_acor_cal.acor, &read_bytes);
+   Parameters:
+   
+   ViSession instr:                 The actual session to opened device.
+   ViPInt32 mode:                   CCS_SERIES_PROC_COMMON, CCS_SERIES_PROC_EVEN_ODD
+                                    or CCS_SERIES_PROC_CLAMPED.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getProcessingMode (ViSession instr, ViPInt32 mode)
+{
+   ViStatus             err      = VI_SUCCESS;
+   CCS_SERIES_data_t    *data;
+   
+   if(mode == VI_NULL) return VI_ERROR_INV_PARAMETER;
+   
+   // get private data
+   if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+   
+   *mode = data->procMode;
    
-         // error mapping
-         if((read_bytes != EE_LENGTH_ACOR) && (!err))   err = VI_ERROR_CCS_SERIES_READ_INCOMPLETE; 
-
-         // when checksum failed but everything else was ok -> assume a blank or new device, generate an array of 1.000 and write it to the EEPROM
-         if(err == VI_ERROR_CYEEPROM_CHKSUM)
-         {
-            for(i=0; i<CCS_SERIES_NUM_PIXELS; i++)
-            {
-               data->factory_acor_cal.acor[i] = 1.0;
-            }
-            err = CCSseries_writeEEPROM(instr, EE_ACOR_FACTORY, 0, EE_LENGTH_ACOR, (ViBuf)data->factory_acor_cal.acor);
-         }
-      }
-      
-      // copy new values
-      for(i=0; i<bufferLength; i++)
-      {
-         AmpCorrFact[i] = (ViReal64)data->factory_acor_cal.acor[i + bufferStart];
-      }
-   }
-    
    return VI_SUCCESS;
 }
 
@@ -1576,6 +2666,7 @@ static ViStatus CCSseries_USB_out(ViSession Instrument_Handle, ViInt16 bRequest,
    unsigned char CCS_SERIES_Error;
    
    err = viUsbControlOut (Instrument_Handle, 0x40, bRequest, wValue, wIndex, wLength, Buffer);
+   if(!err)  CCSseries_scanStopped(Instrument_Handle, bRequest);
 
    if(err == VI_ERROR_IO)
    {
@@ -1616,6 +2707,7 @@ static ViStatus CCSseries_USB_in(ViSession Instrument_Handle, ViInt16 bRequest,
    unsigned char CCS_SERIES_Error;
    
    err = viUsbControlIn (Instrument_Handle, 0xC0, bRequest, wValue, wIndex, wLength, Buffer, Read_Bytes);
+   if(!err)  CCSseries_scanStopped(Instrument_Handle, bRequest);
 
    if(err == VI_ERROR_IO)
    {
@@ -1925,124 +3017,284 @@ static ViStatus CCSseries_checkErrorLevel(ViSession instr, ViStatus code)
    return (code);
 }
 
-#define CCS_DARK_PIXELS_COMMON
-#ifdef CCS_DARK_PIXELS_COMMON
 /*---------------------------------------------------------------------------
- Aquire Raw Scan Data - aquires the raw scan data to inverted values normed
- to one.
+ Start Modus - sets the operation mode (MODUS_*) and remembers it for
+ CCSseries_recover
 ---------------------------------------------------------------------------*/
-static ViStatus CCSseries_aquireRawScanData(ViSession instrumentHandle, ViUInt16 raw[], ViReal64 data[])
+static ViStatus CCSseries_startModus(ViSession instr, ViUInt16 modus)
 {
-#define NO_DARK_PIXELS                 12       // we got 12 dark pixels
-#define DARK_PIXELS_OFFSET             16       // dark pixels start at positon 16 within raw data
-#define SCAN_PIXELS_OFFSET             32       // real measurement start at position 32 within raw data
-#define MAX_ADC_VALUE                  0xFFFF
-
-   CCS_SERIES_data_t    *ccs_data;
-   ViStatus err = VI_SUCCESS;
-   ViReal64 norm_com = 0.0;
-   ViReal64 dark_com = 0.0;
-
-   int i = 0;
-
-   // get private data
-   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
-
-   // sum the dark Pixels
-   for(i = 0; i < NO_DARK_PIXELS; i++)
+   ViStatus             err;
+   CCS_SERIES_data_t    *data = VI_NULL;
+   
+   err = CCSseries_USB_out(instr, CCS_SERIES_WCMD_MODUS, modus, 0, 0, VI_NULL);
+   
+   if(!err && !viGetAttribute(instr, VI_ATTR_USER_DATA, &data) && data)
    {
-      dark_com += raw[(DARK_PIXELS_OFFSET + i)];
+      data->scanMode = modus;
+      
+      // the first scan of the new mode starts no gap
+      data->drop_last = 0.0;
+      data->drop_niv = 0;
    }
+   return err;
+}
 
-   // calculate dark current average
-   dark_com /= (double)(NO_DARK_PIXELS);
-
-   // calculate normalizing factor
-   norm_com = 1.0 / ((ViReal64)MAX_ADC_VALUE - dark_com);
-
+/*---------------------------------------------------------------------------
+ Scan Stopped - the device ends any scan mode on every command but get
+ status, so CCSseries_recover must not start the mode again after one
+---------------------------------------------------------------------------*/
+static void CCSseries_scanStopped(ViSession instr, ViInt16 bRequest)
+{
+   CCS_SERIES_data_t    *data = VI_NULL;
+   
+   if(bRequest == CCS_SERIES_RCMD_GET_STATUS)  return;
+   if(!viGetAttribute(instr, VI_ATTR_USER_DATA, &data) && data)  data->scanMode = MODUS_INTERN_SINGLE_SHOT;
+}
 
-   for(i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
+/*---------------------------------------------------------------------------
+ Count Drops - accounts for the scan just read. In internal continuous mode
+ the device overwrites a finished scan that was not transferred before the
+ next one, so a scan arrives less than one period after the device
+ finished it, or not at all. The device finishes its scans on a grid of
+ the scan period, and the estimated completion of the previous scan is
+ carried along it: k periods between it and this arrival mean k - 1 lost
+ scans, less those the read ahead received and dropped itself. Arrivals
+ are host times, so a late read shortens the interval to the next one;
+ the period is therefore the median of the last DROP_INTERVALS intervals,
+ but at least the integration time, and a single short interval cannot
+ take it over. Scans lost before DROP_MIN_INTERVALS intervals of a mode
+ were seen go unnoticed.
+---------------------------------------------------------------------------*/
+static void CCSseries_countDrops(ViSession instr)
+{
+   CCS_SERIES_data_t    *data = VI_NULL;
+   ViReal64             sorted[DROP_INTERVALS];
+   ViReal64             arrival, period, done, k, t;
+   ViUInt32             discarded, fresh, lost, n, i, j;
+   
+   if(viGetAttribute(instr, VI_ATTR_USER_DATA, &data) || !data)  return;
+   if(viGetReadInfo(instr, &arrival, &discarded))                 return;
+   
+   fresh = discarded - data->drop_seen;
+   data->drop_seen = discarded;
+   data->drop_discarded += fresh;
+   data->drop_scans++;
+   data->scan_arrival = arrival;
+   data->scan_lost = fresh;
+   data->scan_intTime = data->intTime;   // the read ahead is flushed on every change
+   
+   // only here does the device set the pace
+   if(data->scanMode != MODUS_INTERN_CONTINUOUS)  return;
+   
+   done = arrival;
+   n = (data->drop_niv < DROP_INTERVALS) ? data->drop_niv : DROP_INTERVALS;
+   if(n >= DROP_MIN_INTERVALS)
+   {
+      // median by insertion sort, there are only a few
+      for(i = 0; i < n; i++)
+      {
+         t = data->drop_iv[i];
+         for(j = i; (j > 0) && (sorted[j - 1] > t); j--)  sorted[j] = sorted[j - 1];
+         sorted[j] = t;
+      }
+      period = sorted[n / 2];
+      if(period < data->intTime)  period = data->intTime;
+      
+      // whole periods from the completion of the previous scan
+      k = floor((arrival - data->drop_done) / period + DROP_SLACK);
+      lost = (k > 1.0 + fresh) ? (ViUInt32)k - 1 - fresh : 0;
+      if(lost)
+      {
+         data->scan_lost += lost;
+         data->drop_lost += lost;
+         data->drop_gaps++;
+         if(lost > data->drop_longest)  data->drop_longest = lost;
+         
+         // keep the newest events
+         i = (data->gap_head + data->gap_cnt) % CCS_SERIES_MAX_GAP_EVENTS;
+         if(data->gap_cnt < CCS_SERIES_MAX_GAP_EVENTS)   data->gap_cnt++;
+         else                                            data->gap_head = (data->gap_head + 1) % CCS_SERIES_MAX_GAP_EVENTS;
+         data->gap_time[i] = arrival;
+         data->gap_lost[i] = lost;
+      }
+      
+      // this scan finished on the grid, which the arrival bounds on both sides
+      done = data->drop_done + ((k > 0.0) ? k : 0.0) * period;
+      if(done > arrival)            done = arrival;
+      if(done < arrival - period)   done = arrival - period;
+   }
+   
+   if(data->drop_last > 0.0)
    {
-      data[i] = (((ViReal64)raw[SCAN_PIXELS_OFFSET + i]) - dark_com) * norm_com;
+      data->drop_iv[data->drop_niv % DROP_INTERVALS] = arrival - data->drop_last;
+      data->drop_niv++;
    }
+   data->drop_last = arrival;
+   data->drop_done = done;
+}
+
+/*---------------------------------------------------------------------------
+ Update Gain - rebuilds the per pixel amplitude correction factors from the
+ selected correction set. Only does work after the set or the correction
+ arrays changed.
+---------------------------------------------------------------------------*/
+static void CCSseries_updateGain(CCS_SERIES_data_t *ccs_data)
+{
+   ViReal64 g;
+   int i;
+
+   if(ccs_data->gain_valid) return;
 
    for(i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
    {
-      // only correct datat that is within ADC range
-      if(data[i] < 1.0)
+      switch(ccs_data->acor_set)
       {
-         data[i] *= ccs_data->factory_acor_cal.acor[i];
+         case ACOR_USE_USER:
+            g = ccs_data->user_acor_cal.acor[i];
+            break;
+         case ACOR_USE_BOTH:
+            g = (ViReal64)ccs_data->factory_acor_cal.acor[i] * ccs_data->user_acor_cal.acor[i];
+            break;
+         default:
+            g = ccs_data->factory_acor_cal.acor[i];
+            break;
       }
+      ccs_data->gain[i]     = g;
+      ccs_data->gain_q16[i] = (ViUInt32)(g * 65536.0 + 0.5);
    }
-
-   
-   return VI_SUCCESS;
+   ccs_data->gain_valid = VI_TRUE;
 }
 
-#else
+
 /*---------------------------------------------------------------------------
  Aquire Raw Scan Data - aquires the raw scan data to inverted values normed
  to one.
+ The dark values are taken according to the processing mode of the handle:
+  CCS_SERIES_PROC_COMMON:   average of all dark pixels
+  CCS_SERIES_PROC_EVEN_ODD: averages of the even and the odd dark pixels,
+                            normalized to the larger one
+  CCS_SERIES_PROC_CLAMPED:  same, each limited to the dark current offset
+                            maximum stored in the device and normalized on
+                            its own, negative results clipped to zero
 ---------------------------------------------------------------------------*/
 static ViStatus CCSseries_aquireRawScanData(ViSession instrumentHandle, ViUInt16 raw[], ViReal64 data[])
 {
-#define NO_DARK_PIXELS                 12       // we got 12 dark pixels
-#define DARK_PIXELS_OFFSET             16       // dark pixels start at positon 16 within raw data
-#define SCAN_PIXELS_OFFSET             32       // real measurement start at position 32 within raw data
-#define MAX_ADC_VALUE                  0xFFFF
-
    CCS_SERIES_data_t    *ccs_data;
    ViStatus err = VI_SUCCESS;
-   ViReal64 norm_com = 0.0;
-   ViReal64 dark_even = 0.0;
-   ViReal64 dark_odd  = 0.0;
+   ViUInt32 sum[2];           // dark pixel sums of even and odd pixels
+   ViReal64 dark[2];          // dark current average of even and odd pixels
+   ViReal64 den[2];           // ADC range above the dark level
+   ViReal64 norm[2];          // normalizing factor of even and odd pixels
 
    int i = 0;
 
    // get private data
    if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
 
+   CCSseries_updateGain(ccs_data);
+
    // sum the dark Pixels
-   for(i = 0; i < NO_DARK_PIXELS; i+= 2)
+   CCSseries_darkSums(raw, sum);
+   dark[0] = (ViReal64)sum[0];
+   dark[1] = (ViReal64)sum[1];
+
+   // calculate dark current average and normalizing factor
+   switch(ccs_data->procMode)
    {
-      dark_even += raw[(DARK_PIXELS_OFFSET + i + 0)];
-      dark_odd  += raw[(DARK_PIXELS_OFFSET + i + 1)];
+      case CCS_SERIES_PROC_CLAMPED:
+         dark[0] /= (double)(NO_DARK_PIXELS / 2);
+         dark[1] /= (double)(NO_DARK_PIXELS / 2);
+         if(dark[0] > ccs_data->evenOffsetMax)  dark[0] = ccs_data->evenOffsetMax;
+         if(dark[1] > ccs_data->oddOffsetMax)   dark[1] = ccs_data->oddOffsetMax;
+         den[0] = (ViReal64)MAX_ADC_VALUE - dark[0];
+         den[1] = (ViReal64)MAX_ADC_VALUE - dark[1];
+         break;
+      case CCS_SERIES_PROC_EVEN_ODD:
+         dark[0] /= (double)(NO_DARK_PIXELS / 2);
+         dark[1] /= (double)(NO_DARK_PIXELS / 2);
+         den[0] = den[1] = (ViReal64)MAX_ADC_VALUE - ((dark[0] > dark[1]) ? dark[0] : dark[1]);
+         break;
+      default:
+         dark[0] = dark[1] = (dark[0] + dark[1]) / (double)(NO_DARK_PIXELS);
+         den[0] = den[1] = (ViReal64)MAX_ADC_VALUE - dark[0];
+         break;
    }
+   // dark pixels at full scale leave no range, normalize to one count then
+   norm[0] = 1.0 / ((den[0] > 0.0) ? den[0] : 1.0);
+   norm[1] = 1.0 / ((den[1] > 0.0) ? den[1] : 1.0);
 
-   // calculate dark current average
-   dark_even /= (double)(NO_DARK_PIXELS / 2);
-   dark_odd  /= (double)(NO_DARK_PIXELS / 2);
+   ccs_data->proc(raw, ccs_data->gain, dark, norm, data);
 
-   // calculate normalizing factor
-   if(dark_even > dark_odd)
-   {
-      norm_com = 1.0 / ((ViReal64)MAX_ADC_VALUE - dark_even);
-   }
-   else
+   if(ccs_data->roi_cnt)
    {
-      norm_com = 1.0 / ((ViReal64)MAX_ADC_VALUE - dark_odd);
+      // running sum the regions of interest are reduced from
+      ccs_data->roi_prefix[0] = 0.0;
+      for(i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
+      {
+         ccs_data->roi_prefix[i + 1] = ccs_data->roi_prefix[i] + data[i];
+      }
    }
 
+   return VI_SUCCESS;
+}
 
-   for(i = 0; i < CCS_SERIES_NUM_PIXELS; i+= 2)
-   {
-      data[i+0] = (((ViReal64)raw[SCAN_PIXELS_OFFSET + i + 0]) - dark_even) * norm_com;
-      data[i+1] = (((ViReal64)raw[SCAN_PIXELS_OFFSET + i + 1]) - dark_odd ) * norm_com;
-   }
 
-   for(i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
+/*---------------------------------------------------------------------------
+ Aquire Raw Scan Data Q16 - same processing as CCSseries_aquireRawScanData in
+ integer arithmetic, for hosts without fast floating point. Results are in
+ Q16.16, 0x10000 corresponding to 1.0 of the floating point path.
+ The normalization costs one division per scan: the reciprocal of the
+ normalizing denominator is taken in Q40 and applied by multiply and shift.
+ Dark values are kept as sums rather than averages so they stay exact.
+---------------------------------------------------------------------------*/
+static ViStatus CCSseries_aquireRawScanDataQ16(ViSession instrumentHandle, ViUInt16 raw[], ViInt32 data[])
+{
+   CCS_SERIES_data_t    *ccs_data;
+   ViStatus err = VI_SUCCESS;
+   ViUInt32 sum[2];
+   int64_t  dark[2];          // even and odd dark sums over ndark pixels each
+   int64_t  denom[2];
+   int64_t  recip[2];
+   int64_t  ndark;
+
+   // get private data
+   if((err = viGetAttribute(instrumentHandle, VI_ATTR_USER_DATA, &ccs_data)) != VI_SUCCESS) return err;
+
+   CCSseries_updateGain(ccs_data);
+
+   CCSseries_darkSums(raw, sum);
+   dark[0] = sum[0];
+   dark[1] = sum[1];
+   ndark = NO_DARK_PIXELS / 2;
+
+   // (raw - dark/ndark) / (MAX - dark/ndark) == (raw*ndark - dark) / (MAX*ndark - dark)
+   switch(ccs_data->procMode)
    {
-      data[i] *= ccs_data->factory_acor_cal.acor[i];
+      case CCS_SERIES_PROC_CLAMPED:
+         if(dark[0] > (int64_t)ccs_data->evenOffsetMax * ndark)  dark[0] = (int64_t)ccs_data->evenOffsetMax * ndark;
+         if(dark[1] > (int64_t)ccs_data->oddOffsetMax  * ndark)  dark[1] = (int64_t)ccs_data->oddOffsetMax  * ndark;
+         denom[0] = (int64_t)MAX_ADC_VALUE * ndark - dark[0];
+         denom[1] = (int64_t)MAX_ADC_VALUE * ndark - dark[1];
+         break;
+      case CCS_SERIES_PROC_EVEN_ODD:
+         denom[0] = denom[1] = (int64_t)MAX_ADC_VALUE * ndark - ((dark[0] > dark[1]) ? dark[0] : dark[1]);
+         break;
+      default:
+         dark[0] = dark[1] = dark[0] + dark[1];
+         ndark = NO_DARK_PIXELS;
+         denom[0] = denom[1] = (int64_t)MAX_ADC_VALUE * ndark - dark[0];
+         break;
    }
+   // dark pixels at full scale leave no range, normalize to one count then
+   recip[0] = ((int64_t)1 << CCS_GEOM_RECIP_SHIFT) / ((denom[0] > 0) ? denom[0] : ndark);
+   recip[1] = ((int64_t)1 << CCS_GEOM_RECIP_SHIFT) / ((denom[1] > 0) ? denom[1] : ndark);
+
+   ccs_data->procQ16(raw, ccs_data->gain_q16, dark, recip, ndark, data);
 
-   
    return VI_SUCCESS;
 }
 
 
-#endif
-
-
 /*---------------------------------------------------------------------------
    Function:   Get Wavelength Parameters
    Purpose:    This function reads the parameters necessary to calculate from
@@ -2186,7 +3438,7 @@ static ViStatus CCSseries_checkNodes(ViInt32 pixel[], ViReal64 wl[], ViInt32 cnt
 ---------------------------------------------------------------------------*/
 static ViStatus CCSseries_nodes2poly(ViInt32 pixel[], ViReal64 wl[], ViInt32 cnt, ViReal64 poly[])
 {
-   if(LeastSquareInterpolation ((int *)pixel, (double *)wl, (int)cnt, (double *)poly)) return VI_ERROR_CCS_SERIES_INV_USER_DATA;
+   if(LeastSquareInterpolation (pixel, wl, (int)cnt, CCS_SERIES_NUM_POLY_POINTS - 1, poly)) return VI_ERROR_CCS_SERIES_INV_USER_DATA;
    return VI_SUCCESS;
 }
 
@@ -2195,60 +3447,95 @@ static ViStatus CCSseries_nodes2poly(ViInt32 pixel[], ViReal64 wl[], ViInt32 cnt
    Function:   Polynom to Wavelength Array
    Purpose:    Calculates wavelenth array from polynom coefficients.
                The poly array must contain 4 elements.
+               Pixels are evaluated in blocks of WL_EVAL_BLOCK with a fixed
+               trip count the compiler vectorizes; the strict monotonicity
+               check is folded into the same pass as branchless counts of
+               rising and falling steps. A monotonic array has its extremes
+               at the ends, so min and max need no search.
 ---------------------------------------------------------------------------*/
-static ViStatus CCSseries_poly2wlArray(CCS_SERIES_wl_cal_t *wl)
-{
-   int      i;
-   ViReal64 d = 0.0;
-   int iDirectionFlag = 0; // 1 means increasing, -1 means decreasing, 0 is an error
-   
-   for (i = 0; i < CCS_SERIES_NUM_PIXELS; i++)
-      wl->wl[i] = wl->poly[0] + (double)i * (wl->poly[1] + (double)i * (wl->poly[2] + (double)i * wl->poly[3]));
+#define WL_EVAL_BLOCK   8
 
+static ViStatus CCSseries_poly2wl(const ViReal64 poly[], ViReal64 wl[], ViPReal64 min, ViPReal64 max)
+{
+   const ViReal64 p0 = poly[0], p1 = poly[1], p2 = poly[2], p3 = poly[3];
+   ViReal64 x[WL_EVAL_BLOCK];
+   ViReal64 prev = p0;     // wl[0] compared with itself counts neither way
+   int      up = 0, down = 0;
+   int      i, k;
    
-   // check if values are decreasing
-   if(wl->wl[0] < wl->wl[1])
-   {
-      iDirectionFlag = 1;  
-   }
-   else if(wl->wl[0] > wl->wl[1])  
-   {
-      iDirectionFlag = -1; 
-   }
-   else
-      return VI_ERROR_CCS_SERIES_INV_USER_DATA;
-   
+   for(k = 0; k < WL_EVAL_BLOCK; k++)  x[k] = (ViReal64)k;
    
-   d = wl->wl[0];
-   for(i = 1; i < CCS_SERIES_NUM_PIXELS; i++)
+   for(i = 0; i + WL_EVAL_BLOCK <= CCS_SERIES_NUM_PIXELS; i += WL_EVAL_BLOCK)
    {
-      if(iDirectionFlag == 1) // increasing
+      for(k = 0; k < WL_EVAL_BLOCK; k++)
       {
-         if(wl->wl[i] <= d)   return VI_ERROR_CCS_SERIES_INV_USER_DATA; 
+         wl[i + k] = p0 + x[k] * (p1 + x[k] * (p2 + x[k] * p3));
+         x[k] += WL_EVAL_BLOCK;
       }
-      else
+      up   += (wl[i] > prev);
+      down += (wl[i] < prev);
+      for(k = 1; k < WL_EVAL_BLOCK; k++)
       {
-         if(wl->wl[i] >= d)   return VI_ERROR_CCS_SERIES_INV_USER_DATA;
+         up   += (wl[i + k] > wl[i + k - 1]);
+         down += (wl[i + k] < wl[i + k - 1]);
       }
-
-      d = wl->wl[i];
+      prev = wl[i + WL_EVAL_BLOCK - 1];
+   }
+   for(; i < CCS_SERIES_NUM_PIXELS; i++)
+   {
+      wl[i] = p0 + (ViReal64)i * (p1 + (ViReal64)i * (p2 + (ViReal64)i * p3));
+      up   += (wl[i] > prev);
+      down += (wl[i] < prev);
+      prev = wl[i];
    }
    
-   if(iDirectionFlag == 1)
+   if(up == CCS_SERIES_NUM_PIXELS - 1)
    {
-      wl->min     = wl->poly[0];
-      wl->max     = wl->wl[CCS_SERIES_NUM_PIXELS - 1];
+      if(min != NULL)   *min = wl[0];
+      if(max != NULL)   *max = wl[CCS_SERIES_NUM_PIXELS - 1];
    }
-   else
+   else if(down == CCS_SERIES_NUM_PIXELS - 1)
    {
-      wl->min     = wl->wl[CCS_SERIES_NUM_PIXELS - 1]; 
-      wl->max     = wl->poly[0];
+      if(min != NULL)   *min = wl[CCS_SERIES_NUM_PIXELS - 1];
+      if(max != NULL)   *max = wl[0];
    }
+   else
+      return VI_ERROR_CCS_SERIES_INV_USER_DATA;
    
    return VI_SUCCESS;
 }
 
 
+static ViStatus CCSseries_poly2wlArray(CCS_SERIES_wl_cal_t *wl)
+{
+   return CCSseries_poly2wl(wl->poly, wl->wl, &wl->min, &wl->max);
+}
+
+
+/*---------------------------------------------------------------------------
+   Function:   Evaluate Wavelength Polynomial
+   Purpose:    This function computes the wavelength data array of a
+               candidate polynomial the way the driver does for its
+               calibrations, without touching the instrument. It returns
+               VI_ERROR_CCS_SERIES_INV_USER_DATA if the wavelengths are not
+               strictly increasing or decreasing, which the driver would
+               refuse as calibration.
+
+   Parameters:
+   
+   ViReal64 _VI_FAR poly[]:               The coefficients (CCS_SERIES_NUM_POLY_POINTS elements).
+   ViReal64 _VI_FAR wavelengthDataArray[]:The wavelength data (CCS_SERIES_NUM_PIXELS elements).
+   ViPReal64 minimumWavelength:           The minimum wavelength, may be NULL.
+   ViPReal64 maximumWavelength:           The maximum wavelength, may be NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_evalWavelengthPoly (ViReal64 _VI_FAR poly[], ViReal64 _VI_FAR wavelengthDataArray[], ViPReal64 minimumWavelength, ViPReal64 maximumWavelength)
+{
+   if((poly == NULL) || (wavelengthDataArray == NULL)) return VI_ERROR_INV_PARAMETER;
+   
+   return CCSseries_poly2wl(poly, wavelengthDataArray, minimumWavelength, maximumWavelength);
+}
+
+
 /*---------------------------------------------------------------------------
    Function:   Read EEPROM factory calibration data polynom coefficients
    Purpose:    This function reads the polynome coefficients necessary to 
@@ -2605,6 +3892,7 @@ static ViStatus CCSseries_getAmplitudeCorrection(ViSession instr)
    if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
    
    // request the data for factory amplitude factors
+   data->gain_valid = VI_FALSE;
    err = CCSseries_readEEPROM(instr, EE_ACOR_FACTORY, 0, EE_LENGTH_ACOR, (ViBuf)data->factory_acor_cal.acor, &read_bytes);
    
    // error mapping
@@ -2824,6 +4112,8 @@ static ViStatus CCSseries_getRawData(ViSession instr, ViUInt16 data[])
    // check for errors 
    if((err = CCSseries_checkErrorLevel(instr, err)))  return (err);  
    
+   CCSseries_countDrops(instr);
+   
    return (err);
 }
 
@@ -2870,173 +4160,80 @@ static uint16_t crc16_block(const void *dat, size_t len)
 
 
 /*-----------------------------------------------------------------------------
-  Least Square logarithm.
+  Least squares polynomial fit through the supporting points.
+  The points are rotated one at a time into the triangular factor R of a QR
+  decomposition (Givens rotations), on a basis scaled to [-1, 1], so the work
+  depends on the number of points only and the normal equations with their
+  squared condition number are never formed. The result is converted back to
+  coefficients of powers of the pixel number.
+  Returns -1 for too few points, points off the sensor or a singular system.
 -----------------------------------------------------------------------------*/
-static int LeastSquareInterpolation (int * PixelArray, double * WaveLengthArray, int iLength, double Coefficients[])
+static int LeastSquareInterpolation (ViInt32 PixelArray[], ViReal64 WaveLengthArray[], int iLength, int order, ViReal64 Coefficients[])
 {
-   double B[MATRIX_ROWS];
-   double A[MATRIX_ROWS][MATRIX_COLS],C[MATRIX_ROWS][MATRIX_COLS];
-   double D[MATRIX_ROWS][MATRIX_COLS],E[MATRIX_ROWS][MATRIX_COLS],F[MATRIX_ROWS][MATRIX_COLS];
-   double detA;
-   double CompleteWavelengthArray[CCS_SERIES_NUM_PIXELS];
-   int i;
+   ViReal64 R[CCS_SERIES_MAX_FIT_ORDER + 1][CCS_SERIES_MAX_FIT_ORDER + 1];
+   ViReal64 q[CCS_SERIES_MAX_FIT_ORDER + 1], row[CCS_SERIES_MAX_FIT_ORDER + 1], a[CCS_SERIES_MAX_FIT_ORDER + 1];
+   ViReal64 t, y, r, c, s, u, v, binom, scale;
+   int      n = order + 1;
+   int      i, j, k;
    
-   if(iLength < MATRIX_ROWS)
+   if((order < 1) || (order > CCS_SERIES_MAX_FIT_ORDER) || (iLength < n))
       return -1;
    
-   // clear CompleteWavelengthArray
-   memset(CompleteWavelengthArray, 0, sizeof(double) * CCS_SERIES_NUM_PIXELS);
+   memset(R, 0, sizeof(R));
+   memset(q, 0, sizeof(q));
    
-   // fill CompleteWavelengthArray with the supporting points
    for(i = 0; i < iLength; i++)
    {
-      if((PixelArray[i] < 0) || (PixelArray[i] > CCS_SERIES_NUM_PIXELS))   break;
-      CompleteWavelengthArray[PixelArray[i]] = WaveLengthArray[i];   
+      if((PixelArray[i] < 0) || (PixelArray[i] >= CCS_SERIES_NUM_PIXELS) || (WaveLengthArray[i] <= 0.0))   return -1;
+      
+      t = (PixelArray[i] - FIT_CENTER) / FIT_CENTER;
+      row[0] = 1.0;
+      for(k = 1; k < n; k++)  row[k] = row[k - 1] * t;
+      y = WaveLengthArray[i];
+      
+      // annihilate the new row against R, carrying the right hand side along
+      for(k = 0; k < n; k++)
+      {
+         if(row[k] == 0.0) continue;
+         r = hypot(R[k][k], row[k]);
+         c = R[k][k] / r;
+         s = row[k] / r;
+         for(j = k; j < n; j++)
+         {
+            u = R[k][j];
+            v = row[j];
+            R[k][j] = c * u + s * v;
+            row[j]  = c * v - s * u;
+         }
+         u = q[k];
+         q[k] = c * u + s * y;
+         y    = c * y - s * u;
+      }
    }
-
-   
-   A[0][0] = iLength;
-   A[0][1] = SpecSummation(CompleteWavelengthArray,1,CCS_SERIES_NUM_PIXELS);
-   A[0][2] = SpecSummation(CompleteWavelengthArray,2,CCS_SERIES_NUM_PIXELS);
-   A[0][3] = SpecSummation(CompleteWavelengthArray,3,CCS_SERIES_NUM_PIXELS);
-
-   A[1][0] = SpecSummation(CompleteWavelengthArray,1,CCS_SERIES_NUM_PIXELS);
-   A[1][1] = SpecSummation(CompleteWavelengthArray,2,CCS_SERIES_NUM_PIXELS);
-   A[1][2] = SpecSummation(CompleteWavelengthArray,3,CCS_SERIES_NUM_PIXELS);
-   A[1][3] = SpecSummation(CompleteWavelengthArray,4,CCS_SERIES_NUM_PIXELS);
-
-   A[2][0] = SpecSummation(CompleteWavelengthArray,2,CCS_SERIES_NUM_PIXELS);
-   A[2][1] = SpecSummation(CompleteWavelengthArray,3,CCS_SERIES_NUM_PIXELS);
-   A[2][2] = SpecSummation(CompleteWavelengthArray,4,CCS_SERIES_NUM_PIXELS);
-   A[2][3] = SpecSummation(CompleteWavelengthArray,5,CCS_SERIES_NUM_PIXELS);
-
-   A[3][0] = SpecSummation(CompleteWavelengthArray,3,CCS_SERIES_NUM_PIXELS);
-   A[3][1] = SpecSummation(CompleteWavelengthArray,4,CCS_SERIES_NUM_PIXELS);
-   A[3][2] = SpecSummation(CompleteWavelengthArray,5,CCS_SERIES_NUM_PIXELS);
-   A[3][3] = SpecSummation(CompleteWavelengthArray,6,CCS_SERIES_NUM_PIXELS);
-   
-   
-   B[0] = Summation(CompleteWavelengthArray,CCS_SERIES_NUM_PIXELS);
-   B[1] = Spec2Summation(CompleteWavelengthArray,1,CCS_SERIES_NUM_PIXELS);
-   B[2] = Spec2Summation(CompleteWavelengthArray,2,CCS_SERIES_NUM_PIXELS);
-   B[3] = Spec2Summation(CompleteWavelengthArray,3,CCS_SERIES_NUM_PIXELS);
    
-   MergeMC(A,B,C,0);
-   MergeMC(A,B,D,1);
-   MergeMC(A,B,E,2);
-   MergeMC(A,B,F,3);
-   
-   detA = Determinant(A);
-   
-   if (detA == 0.0){
-      return -1;
+   // back substitution
+   for(k = n - 1; k >= 0; k--)
+   {
+      if(fabs(R[k][k]) <= 1e-12 * fabs(R[0][0]))   return -1;
+      s = q[k];
+      for(j = k + 1; j < n; j++)   s -= R[k][j] * a[j];
+      a[k] = s / R[k][k];
    }
-
-   Coefficients[0] = Determinant(C) / detA;
-   Coefficients[1] = Determinant(D) / detA;
-   Coefficients[2] = Determinant(E) / detA;
-   Coefficients[3] = Determinant(F) / detA;
    
-   return 0;
-}
-
-static double Summation(double *pdata, int values)
-{
-   double tmp=0.0;
-
-   do {
-      tmp += *pdata;
-      ++pdata;
-   } while (--values);
-
-   return(tmp);
-}
-
-
-static double SpecSummation(double *pcorrel,int pwr,int values)
-{
-   double tmp=0.0;
-   int pixel=0;
-
-   do {
-      if (*pcorrel > 0.0) tmp += pow((double)pixel,(double)pwr);
-      ++pcorrel;
-      ++pixel;
-   } while (--values);
-
-   return(tmp);
-}
-
-static double Spec2Summation(double *pcorrel,int pwr,int values)
-{
-   double tmp=0.0;
-   int pixel=0;
-
-   do {
-      if (*pcorrel > 0.0) tmp += *pcorrel * pow((double)pixel,(double)pwr);
-      ++pcorrel;
-      ++pixel;
-   } while (--values);
-
-   return(tmp);
-}
-
-
-static void MergeMC(double s[MATRIX_ROWS][MATRIX_COLS], double i[MATRIX_ROWS], double d[MATRIX_ROWS][MATRIX_COLS], int column)
-{
-   int x,y;
-
-   for (x = 0; x < MATRIX_COLS; x++)
+   // a[k] * ((p - FIT_CENTER) / FIT_CENTER)^k expanded into powers of p
+   memset(Coefficients, 0, n * sizeof(ViReal64));
+   for(k = 0; k < n; k++)
    {
-      if (x == column) 
-      {
-         for (y = 0; y < MATRIX_ROWS; y++) 
-            d[y][x] = i[y];
-      }
-      else
+      scale = a[k] / pow(FIT_CENTER, k);
+      binom = 1.0;
+      for(j = 0; j <= k; j++)
       {
-         for (y = 0; y < MATRIX_ROWS; y++)
-            d[y][x] = s[y][x];
+         Coefficients[j] += scale * binom * pow(-FIT_CENTER, k - j);
+         binom = binom * (k - j) / (j + 1);
       }
    }
-}
-
-
-
-static double Determinant(double mt[MATRIX_ROWS][MATRIX_COLS])
-{
-   double a=mt[0][0],b=mt[0][1],c=mt[0][2],d=mt[0][3];
-   double e=mt[1][0],f=mt[1][1],g=mt[1][2],h=mt[1][3];
-   double i=mt[2][0],j=mt[2][1],k=mt[2][2],l=mt[2][3];
-   double m=mt[3][0],n=mt[3][1],o=mt[3][2],p=mt[3][3];
-   double tmp=0.0;
-
-   tmp =  a * f * k * p;
-   tmp -= a * f * l * o;
-   tmp -= a * j * g * p;
-   tmp += a * j * h * o;
-   tmp += a * n * g * l;
-   tmp -= a * n * h * k;
-   tmp -= e * b * k * p;
-   tmp += e * b * l * o;
-   tmp += e * j * c * p;
-   tmp -= e * j * d * o;
-   tmp -= e * n * c * l;
-   tmp += e * n * d * k;
-   tmp += i * b * g * p;
-   tmp -= i * b * h * o;
-   tmp -= i * f * c * p;
-   tmp += i * f * d * o;
-   tmp += i * n * c * h;
-   tmp -= i * n * d * g;
-   tmp -= m * b * g * l;
-   tmp += m * b * h * k;
-   tmp += m * f * c * l;
-   tmp -= m * f * d * k;
-   tmp -= m * j * c * h;
-   tmp += m * j * d * g;
-
-   return(tmp);
+   
+   return 0;
 }
 
 /****************************************************************************
@@ -86,10 +86,15 @@
 #define CCS_SERIES_TEXT_BUFFER_SIZE          CCS_SERIES_BUFFER_SIZE  // buffer size for texts from the SPX
 #define CCS_SERIES_NUM_PIXELS                3648                    // number of effective pixels of CCD
 #define CCS_SERIES_NUM_RAW_PIXELS            3694                    // number of raw pixels
+#define CCS_SERIES_NUM_POLY_POINTS           4                       // coefficients of the pixel - wavelength polynomial
 #define CCS_SERIES_MAX_USER_NAME_SIZE        32                      // including the trailing '\0'
 
 #define CCS_SERIES_MIN_NUM_USR_ADJ           4                       // minimum number of user adjustment data points
 #define CCS_SERIES_MAX_NUM_USR_ADJ           10                      // maximum number of user adjustment data points
+#define CCS_SERIES_MAX_ROIS                  32                      // maximum number of regions of interest
+#define CCS_SERIES_MAX_GAP_EVENTS            32                      // gap events CCSseries_getGapEvents keeps
+#define CCS_SERIES_MAX_DEVICES               32                      // spectrometers CCSseries_findRsrc reports
+#define CCS_SERIES_MAX_FIT_ORDER             (CCS_SERIES_MAX_NUM_USR_ADJ - 1)   // highest order CCSseries_fitPolynomial handles
 
 /*---------------------------------------------------------------------------
  CCS_SERIES specific constants
@@ -177,6 +182,55 @@
 
 
 ===========================================================================*/
+/*---------------------------------------------------------------------------
+   Function:   Find Resources
+   Purpose:    This function scans the USB once for all attached CCS series
+               spectrometers (every model in CCS_SERIES_FIND_PATTERN) and
+               keeps their resource names and serial numbers for
+               CCSseries_getRsrcName and CCSseries_getRsrcInfo. Resource
+               names have the form vid:pid:serial and select exactly that
+               unit in CCSseries_init; opening several units after one scan
+               does not walk the bus again.
+               The list is shared by the whole process and not reentrant:
+               call CCSseries_findRsrc, CCSseries_getRsrcName and
+               CCSseries_getRsrcInfo from one thread, or serialize them.
+
+   Parameters:
+
+   ViPUInt32 resourceCount:   Number of spectrometers found, at most
+                              CCS_SERIES_MAX_DEVICES.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_findRsrc (ViPUInt32 resourceCount);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Resource Name
+   Purpose:    This function returns the resource name of a spectrometer
+               found by the last CCSseries_findRsrc, for CCSseries_init.
+
+   Parameters:
+
+   ViUInt32 index:            0 ... resourceCount - 1.
+   ViChar resourceName[]:     The resource name (CCS_SERIES_BUFFER_SIZE).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getRsrcName (ViUInt32 index, ViChar _VI_FAR resourceName[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Resource Information
+   Purpose:    This function returns model and serial number of a
+               spectrometer found by the last CCSseries_findRsrc.
+
+   Parameters:
+
+   ViUInt32 index:            0 ... resourceCount - 1.
+   ViChar modelName[]:        The model name, e.g. "CCS175" (CCS_SERIES_BUFFER_SIZE),
+                              may be VI_NULL.
+   ViChar serialNumber[]:     The serial number (CCS_SERIES_BUFFER_SIZE), may be VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getRsrcInfo (ViUInt32 index, ViChar _VI_FAR modelName[], ViChar _VI_FAR serialNumber[]);
+
+
 /*---------------------------------------------------------------------------
    Function:   Initialize
    Purpose:    This function initializes the instrument driver session and
@@ -203,6 +257,27 @@ ViStatus _VI_FUNC CCSseries_init (ViRsrc resourceName, ViBoolean IDQuery,
 ViStatus _VI_FUNC CCSseries_close (ViSession instrumentHandle);
 
 
+/*---------------------------------------------------------------------------
+   Function:   Recover
+   Purpose:    This function brings a session back after the spectrometer
+               was unplugged or reset, which makes every call fail with
+               VI_ERROR_CONN_LOST. It waits for the unit with the same
+               serial number to appear on the USB again and reopens it
+               under the same instrument handle. The integration time and,
+               except for a pending internal single shot, the scan mode are
+               restored; a mode that a later command already ended is not.
+               Calibration and amplitude correction are kept from
+               CCSseries_init and not read from the device again.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 timeout:          Time in ms to wait for the device to come back,
+                              0 tries once. VI_ERROR_RSRC_NFOUND if it did not.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_recover (ViSession instrumentHandle, ViUInt32 timeout);
+
+
 /*===========================================================================
 
 
@@ -214,6 +289,10 @@ ViStatus _VI_FUNC CCSseries_close (ViSession instrumentHandle);
    Function:   Set Integration Time
    Purpose:    This function set the optical integration time in seconds.
 
+               The device ends any scan mode with it, and scans still
+               buffered on the host are discarded since they were taken
+               with the old time. Start the scan mode again afterwards.
+
    Parameters:
 
    ViSession instr:           The actual session to opened device.
@@ -342,6 +421,247 @@ ViStatus _VI_FUNC CCSseries_getDeviceStatus (ViSession instrumentHandle, ViPInt3
 ViStatus _VI_FUNC CCSseries_getScanData (ViSession instrumentHandle, ViReal64 _VI_FAR data[]);
 
 
+/*---------------------------------------------------------------------------
+   Function:   Try Get Scan Data
+   Purpose:    This function reads out the processed scan data like
+               CCSseries_getScanData, but never waits for the device. If no
+               complete scan is buffered yet it returns VI_SUCCESS_QUEUE_EMPTY
+               at once and leaves data untouched, so one thread can poll
+               several spectrometers.
+               The first call starts reading scans ahead in the background;
+               CCSseries_getScanData then also returns those buffered scans,
+               oldest first. A few scans are kept, older ones are dropped.
+               CCSseries_reset stops the read ahead and discards them.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViReal64 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_tryGetScanData (ViSession instrumentHandle, ViReal64 _VI_FAR data[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Event File Descriptor
+   Purpose:    This function returns a file descriptor that becomes readable
+               when CCSseries_tryGetScanData has a scan (or an error) to
+               hand out, for use with poll, epoll or io_uring next to other
+               I/O. It starts reading scans ahead like
+               CCSseries_tryGetScanData does. Each CCSseries_tryGetScanData
+               that returns a scan or an error consumes one readiness count,
+               so level triggered polling works; do not read from the
+               descriptor yourself.
+               The descriptor stays valid until CCSseries_close and keeps
+               working across CCSseries_reset and CCSseries_recover.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViPInt32 fd:               The file descriptor.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanEventFd (ViSession instrumentHandle, ViPInt32 fd);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Data And Raw
+   Purpose:    This function reads out one scan like CCSseries_getScanData
+               and returns the raw ADC values it was processed from as well.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt16 _VI_FAR raw[]:    The raw scan (CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViReal64 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanDataAndRaw (ViSession instrumentHandle, ViUInt16 _VI_FAR raw[], ViReal64 _VI_FAR data[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Try Get Scan Data And Raw
+   Purpose:    This function is CCSseries_tryGetScanData that also returns
+               the raw ADC values of the scan.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt16 _VI_FAR raw[]:    The raw scan (CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViReal64 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_tryGetScanDataAndRaw (ViSession instrumentHandle, ViUInt16 _VI_FAR raw[], ViReal64 _VI_FAR data[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Start Burst
+   Purpose:    This function captures a burst of externally triggered scans
+               without losing any between triggers. It arms continuous
+               external triggering, discards what an earlier mode left in
+               the USB pipe and has a background thread keep a bulk read
+               posted, reading each scan straight into raw and recording
+               the host time it arrived. Triggers before this function
+               returns are not part of the burst.
+               Use CCSseries_waitBurst to wait for the scans and to get
+               them processed into data. The arrays have to stay valid until
+               the burst is complete or the session is cleared, reset,
+               recovered or closed, which ends the burst. Once complete,
+               further triggers are buffered for CCSseries_tryGetScanData
+               until another mode is started.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 count:            The number of scans in the burst.
+   ViUInt16 _VI_FAR raw[]:    The raw scans
+                              (count * CCS_SERIES_NUM_RAW_PIXELS elements).
+   ViReal64 _VI_FAR data[]:   The processed scans
+                              (count * CCS_SERIES_NUM_PIXELS elements),
+                              VI_NULL for raw scans only.
+   ViReal64 _VI_FAR timestamps[]: The arrival time of each scan in seconds
+                              on CLOCK_MONOTONIC (count elements), may be
+                              VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_startBurst (ViSession instrumentHandle, ViUInt32 count, ViUInt16 _VI_FAR raw[], ViReal64 _VI_FAR data[], ViReal64 _VI_FAR timestamps[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Wait Burst
+   Purpose:    This function waits for the burst started with
+               CCSseries_startBurst to complete and processes the scans
+               that arrived since the last call into the data array.
+               While the burst is incomplete after the timeout it returns
+               VI_ERROR_TMO and the capture goes on, so it can be called
+               repeatedly to work on a burst as it comes in. An error that
+               ended the burst early is returned with the number of scans
+               captured before it.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 timeout:          Time in ms to wait, 0 only looks.
+   ViPUInt32 captured:        The number of scans captured so far, may be
+                              VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_waitBurst (ViSession instrumentHandle, ViUInt32 timeout, ViPUInt32 captured);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Drop Statistics
+   Purpose:    This function tells how many scans were lost since
+               CCSseries_init or CCSseries_resetDropStatistics because they
+               were not read in time, to size buffers and thread priorities
+               by. Two kinds of loss are counted:
+               In internal continuous mode (CCSseries_startScanCont) the
+               device overwrites a scan that was not transferred before the
+               next one is done. These are inferred from when the scans
+               arrived at the host: k scan periods between the completion
+               of one scan and the arrival of the next mean k - 1 lost.
+               The period is the median of the last few intervals between
+               arrivals, at least the integration time, so one late read
+               does not make later scans look lost, and gaps in the first
+               few scans after the start go unnoticed.
+               Scans the read ahead of CCSseries_tryGetScanData received
+               but dropped because its queue was full are counted exactly,
+               in every mode.
+               Every output may be VI_NULL.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViPUInt32 scans:           The number of scans read.
+   ViPUInt32 dropped:         The number of scans the device overwrote.
+   ViPUInt32 gaps:            The number of gaps the overwritten scans fell
+                              into, see CCSseries_getGapEvents.
+   ViPUInt32 longestGap:      The most scans overwritten in one gap.
+   ViPUInt32 discarded:       The number of scans the read ahead dropped.
+   ViPReal64 overrun:         The fraction of all scans lost either way,
+                              0 to 1.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getDropStatistics (ViSession instrumentHandle, ViPUInt32 scans, ViPUInt32 dropped, ViPUInt32 gaps, ViPUInt32 longestGap, ViPUInt32 discarded, ViPReal64 overrun);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Gap Events
+   Purpose:    This function hands out the gaps CCSseries_getDropStatistics
+               counted, oldest first, and forgets them. Only the newest
+               CCS_SERIES_MAX_GAP_EVENTS are kept.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt32 maxCount:         The size of the arrays.
+   ViReal64 _VI_FAR timestamps[]: The arrival of the first scan after each
+                              gap in seconds on CLOCK_MONOTONIC, may be
+                              VI_NULL.
+   ViUInt32 _VI_FAR lost[]:   The number of scans lost in each gap, may be
+                              VI_NULL.
+   ViPUInt32 count:           The number of gaps returned.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getGapEvents (ViSession instrumentHandle, ViUInt32 maxCount, ViReal64 _VI_FAR timestamps[], ViUInt32 _VI_FAR lost[], ViPUInt32 count);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Reset Drop Statistics
+   Purpose:    This function sets the counts of CCSseries_getDropStatistics
+               to zero and forgets the gap events.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_resetDropStatistics (ViSession instrumentHandle);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Info
+   Purpose:    This function tells when the scan handed out last arrived at
+               the host and how many scans were lost right before it, in
+               the sense of CCSseries_getDropStatistics. Numbering scans by
+               one plus the lost ones each keeps the numbers in step with
+               the device. It also tells the integration time the scan was
+               taken with.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViPReal64 arrival:         The arrival in seconds on CLOCK_MONOTONIC,
+                              may be VI_NULL.
+   ViPUInt32 lost:            The number of scans the device overwrote or
+                              the read ahead dropped since the scan before,
+                              may be VI_NULL.
+   ViPReal64 integrationTime: The integration time of the scan in seconds,
+                              may be VI_NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanInfo (ViSession instrumentHandle, ViPReal64 arrival, ViPUInt32 lost, ViPReal64 integrationTime);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Data Q16
+   Purpose:    This function reads out the processed scan data like
+               CCSseries_getScanData, computed in integer arithmetic.
+               Values are fixed point Q16.16: 0x10000 corresponds to 1.0.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViInt32 _VI_FAR data[]:    The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanDataQ16 (ViSession instrumentHandle, ViInt32 _VI_FAR data[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Scan Data U16
+   Purpose:    This function reads out the processed scan data like
+               CCSseries_getScanData, computed in integer arithmetic and
+               scaled so that 0xFFFF corresponds to 1.0. Values outside
+               0.0 ... 1.0 are clipped.
+
+   Parameters:
+
+   ViSession instr:           The actual session to opened device.
+   ViUInt16 _VI_FAR data[]:   The measurement array (CCS_SERIES_NUM_PIXELS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getScanDataU16 (ViSession instrumentHandle, ViUInt16 _VI_FAR data[]);
+
+
 /*---------------------------------------------------------------------------
    Function:   Get Raw Scan Data
    Purpose:    This function reads out the raw scan data.
@@ -355,6 +675,51 @@ ViStatus _VI_FUNC CCSseries_getScanData (ViSession instrumentHandle, ViReal64 _V
 ViStatus _VI_FUNC CCSseries_getRawScanData (ViSession instrumentHandle, ViInt32 _VI_FAR scanDataArray[]);
 
 
+/*---------------------------------------------------------------------------
+   Function:   Set Regions Of Interest
+   Purpose:    This function registers wavelength windows that
+               CCSseries_getROIData reduces every scan to. A window covers
+               all pixels whose wavelength lies within [lower, upper] of
+               the given calibration data set. Pass count 0 to remove all
+               regions.
+
+               The windows are kept in nm and resolved to pixel ranges
+               again whenever CCSseries_setWavelengthData changes the
+               calibration they refer to. If a window then holds no pixel
+               any more all regions are removed.
+
+   Parameters:
+
+   ViSession instr:                       The actual session to opened device.
+   ViInt16 dataSet:                       Factory or user calibration.
+   ViUInt32 count:                        Number of windows, at most CCS_SERIES_MAX_ROIS.
+   ViReal64 _VI_FAR lowerWavelength[]:    Lower window limits in nm.
+   ViReal64 _VI_FAR upperWavelength[]:    Upper window limits in nm.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_setROIs (ViSession instrumentHandle, ViInt16 dataSet, ViUInt32 count,
+                                     ViReal64 _VI_FAR lowerWavelength[], ViReal64 _VI_FAR upperWavelength[]);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get ROI Data
+   Purpose:    This function reads out one processed scan like
+               CCSseries_getScanData but returns only the sum, mean and
+               maximum of the scan data within each region registered with
+               CCSseries_setROIs.
+
+   Note:
+   If you do not need some of the arrays you may pass NULL.
+
+   Parameters:
+
+   ViSession instr:                       The actual session to opened device.
+   ViReal64 _VI_FAR sum[]:                Sum over each region (one element per region).
+   ViReal64 _VI_FAR mean[]:               Mean over each region.
+   ViReal64 _VI_FAR maximum[]:            Maximum within each region.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getROIData (ViSession instrumentHandle, ViReal64 _VI_FAR sum[], ViReal64 _VI_FAR mean[], ViReal64 _VI_FAR maximum[]);
+
+
 /*---------------------------------------------------------------------------
    Function:   Set Wavelength Data
    Purpose:    This function stores data for user-defined pixel-wavelength
@@ -408,6 +773,64 @@ ViStatus _VI_FUNC CCSseries_getWavelengthData (ViSession instrumentHandle, ViInt
 
 
 
+/*---------------------------------------------------------------------------
+   Function:   Get Wavelength Polynomial
+   Purpose:    This function returns the coefficients of the polynomial
+               the wavelength data array is computed from:
+               wl(pixel) = poly[0] + poly[1]*pixel + poly[2]*pixel^2 + poly[3]*pixel^3
+
+   Parameters:
+
+   ViSession instr:                       The actual session to opened device.
+   ViInt16 dataSet:                       Factory or user calibration.
+   ViReal64 _VI_FAR poly[]:               The coefficients (CCS_SERIES_NUM_POLY_POINTS elements).
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getWavelengthPoly (ViSession instrumentHandle, ViInt16 dataSet, ViReal64 _VI_FAR poly[]);
+
+
+
+/*---------------------------------------------------------------------------
+   Function:   Evaluate Wavelength Polynomial
+   Purpose:    This function computes the wavelength data array of a
+               candidate polynomial the way the driver does for its
+               calibrations, without touching the instrument. It returns
+               VI_ERROR_CCS_SERIES_INV_USER_DATA if the wavelengths are not
+               strictly increasing or decreasing, which the driver would
+               refuse as calibration.
+
+   Parameters:
+
+   ViReal64 _VI_FAR poly[]:               The coefficients (CCS_SERIES_NUM_POLY_POINTS elements).
+   ViReal64 _VI_FAR wavelengthDataArray[]:The wavelength data (CCS_SERIES_NUM_PIXELS elements).
+   ViPReal64 minimumWavelength:           The minimum wavelength, may be NULL.
+   ViPReal64 maximumWavelength:           The maximum wavelength, may be NULL.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_evalWavelengthPoly (ViReal64 _VI_FAR poly[], ViReal64 _VI_FAR wavelengthDataArray[],
+                                                ViPReal64 minimumWavelength, ViPReal64 maximumWavelength);
+
+
+
+/*---------------------------------------------------------------------------
+   Function:   Fit Polynomial
+   Purpose:    This function fits a polynomial of the given order through
+               pixel-wavelength supporting points in the least squares
+               sense, the way the driver computes the user calibration
+               (which is of order 3) in CCSseries_setWavelengthData. It does
+               not change any calibration of the instrument.
+
+   Parameters:
+
+   ViInt32 _VI_FAR pixelDataArray[]:      The pixel numbers of the supporting points.
+   ViReal64 _VI_FAR wavelengthDataArray[]:Their wavelengths.
+   ViInt32 bufferLength:                  The number of supporting points, at least order + 1.
+   ViInt32 order:                         1 ... CCS_SERIES_MAX_FIT_ORDER.
+   ViReal64 _VI_FAR poly[]:               The order + 1 coefficients, lowest power first.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_fitPolynomial (ViInt32 _VI_FAR pixelDataArray[], ViReal64 _VI_FAR wavelengthDataArray[],
+                                           ViInt32 bufferLength, ViInt32 order, ViReal64 _VI_FAR poly[]);
+
+
+
 /*---------------------------------------------------------------------------
    Function:   Get Wavelength Data
    Purpose:    This function returns the user-defined pixel-wavelength
@@ -489,6 +912,83 @@ ViStatus _VI_FUNC CCSseries_setAmplitudeData (ViSession instr, ViReal64 AmpCorrF
 
 ViStatus _VI_FUNC CCSseries_getAmplitudeData (ViSession instr, ViReal64 AmpCorrFact[], ViInt32 bufferStart, ViInt32 bufferLength, ViInt32 mode);
 
+
+/*---------------------------------------------------------------------------
+   Function:   Set Amplitude Correction Set
+   Purpose:    This function selects which amplitude correction factors are
+               applied to the scan data: the factory set (default), the
+               user set, or the product of both.
+               The resulting factors are computed once when the selection
+               or a set changes, not per scan.
+
+   Parameters:
+
+   ViSession instr:                 The actual session to opened device.
+   ViInt32 set:                     ACOR_USE_FACTORY, ACOR_USE_USER or ACOR_USE_BOTH.
+                                    Other values return VI_ERROR_INV_PARAMETER.
+---------------------------------------------------------------------------*/
+#define ACOR_USE_FACTORY            0
+#define ACOR_USE_USER               1
+#define ACOR_USE_BOTH               2
+
+ViStatus _VI_FUNC CCSseries_setAmplitudeCorrectionSet (ViSession instr, ViInt32 set);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Amplitude Correction Set
+   Purpose:    This function returns the amplitude correction set applied
+               to the scan data.
+
+   Parameters:
+
+   ViSession instr:                 The actual session to opened device.
+   ViPInt32 set:                    ACOR_USE_FACTORY, ACOR_USE_USER or ACOR_USE_BOTH.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getAmplitudeCorrectionSet (ViSession instr, ViPInt32 set);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Set Processing Mode
+   Purpose:    This function selects how the dark pixels of each scan are
+               applied to the data returned by CCSseries_getScanData and
+               the other processed scan functions.
+
+               CCS_SERIES_PROC_COMMON (default): one dark value, the
+               average of all dark pixels. Saturated pixels are not
+               amplitude corrected.
+               CCS_SERIES_PROC_EVEN_ODD: separate dark values for even
+               and odd pixels, normalized to the larger one.
+               CCS_SERIES_PROC_CLAMPED: separate dark values for even and
+               odd pixels, each limited to the dark current offset maximum
+               stored in the device and normalized on its own; values
+               below zero are clipped (processing of the SPx driver).
+
+   Parameters:
+
+   ViSession instr:                 The actual session to opened device.
+   ViInt32 mode:                    One of the modes above. Other values
+                                    return VI_ERROR_INV_PARAMETER.
+---------------------------------------------------------------------------*/
+#define CCS_SERIES_PROC_COMMON      0
+#define CCS_SERIES_PROC_EVEN_ODD    1
+#define CCS_SERIES_PROC_CLAMPED     2
+
+ViStatus _VI_FUNC CCSseries_setProcessingMode (ViSession instr, ViInt32 mode);
+
+
+/*---------------------------------------------------------------------------
+   Function:   Get Processing Mode
+   Purpose:    This function returns the processing mode of the session.
+
+   Parameters:
+
+   ViSession instr:                 The actual session to opened device.
+   ViPInt32 mode:                   CCS_SERIES_PROC_COMMON, CCS_SERIES_PROC_EVEN_ODD
+                                    or CCS_SERIES_PROC_CLAMPED.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC CCSseries_getProcessingMode (ViSession instr, ViPInt32 mode);
+
+
 /*===========================================================================
 
 
@@ -0,0 +1,314 @@
+/* C++ interface for CCS series spectrometers.
+ *
+ * ccs::Device owns an open spectrometer (CCSseries_init/CCSseries_close)
+ * and hands out scans as ccs::Frame objects. A frame holds the raw ADC
+ * values, the processed data and when and how the scan was taken; its
+ * storage comes from a FramePool allocated once and goes back there when
+ * the frame is destroyed, so reading scans does not allocate:
+ *
+ *     ccs::Device dev(ccs::Device::find().at(0));
+ *     dev.set_integration_time(0.01);
+ *     dev.start_continuous();
+ *     for (;;) {
+ *         ccs::Frame f = dev.read();
+ *         use(f.data(), f.raw(), f.sequence());
+ *     }
+ *
+ * Driver errors are thrown as ccs::Error. Header only; link the driver
+ * library as for the C API. */
+#ifndef __ccs_hpp__
+#define __ccs_hpp__
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vitypes.h"
+#include "CCS_Series_Drv.h"
+
+namespace ccs {
+
+class Spectrometer;
+
+class Error : public std::runtime_error {
+public:
+    Error(ViSession instr, ViStatus status) : std::runtime_error(describe(instr, status)), status_(status) {}
+
+    ViStatus status() const noexcept { return status_; }
+
+private:
+    static std::string describe(ViSession instr, ViStatus status) {
+        ViChar msg[CCS_SERIES_ERR_DESCR_BUFFER_SIZE];
+
+        CCSseries_errorMessage(instr, status, msg);
+        return msg;
+    }
+
+    ViStatus status_;
+};
+
+// warnings and completion codes are positive and not thrown
+inline void check(ViSession instr, ViStatus err) {
+    if (err < 0) {
+        throw Error(instr, err);
+    }
+}
+
+
+// storage of one frame
+struct FrameBuffer {
+    ViUInt16 raw[CCS_SERIES_NUM_RAW_PIXELS];
+    ViReal64 data[CCS_SERIES_NUM_PIXELS];
+    uint64_t sequence;                              // counts the device's scans, lost ones leave gaps
+    std::chrono::steady_clock::time_point time;     // when the scan arrived at the host
+    ViReal64 integrationTime;                       // in seconds
+};
+
+class FramePool;
+
+/* A scan borrowed from a FramePool, returned to it when destroyed. Empty
+ * after being moved from. */
+class Frame {
+public:
+    Frame() noexcept = default;
+    Frame(Frame &&o) noexcept : buf_(std::exchange(o.buf_, nullptr)), pool_(std::exchange(o.pool_, nullptr)) {}
+    Frame &operator=(Frame &&o) noexcept {
+        if (this != &o) {
+            release();
+            buf_ = std::exchange(o.buf_, nullptr);
+            pool_ = std::exchange(o.pool_, nullptr);
+        }
+        return *this;
+    }
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+    ~Frame() { release(); }
+
+    explicit operator bool() const noexcept { return buf_ != nullptr; }
+
+    std::span<ViReal64, CCS_SERIES_NUM_PIXELS> data() noexcept { return std::span<ViReal64, CCS_SERIES_NUM_PIXELS>(buf_->data); }
+    std::span<const ViReal64, CCS_SERIES_NUM_PIXELS> data() const noexcept { return std::span<const ViReal64, CCS_SERIES_NUM_PIXELS>(buf_->data); }
+    std::span<ViUInt16, CCS_SERIES_NUM_RAW_PIXELS> raw() noexcept { return std::span<ViUInt16, CCS_SERIES_NUM_RAW_PIXELS>(buf_->raw); }
+    std::span<const ViUInt16, CCS_SERIES_NUM_RAW_PIXELS> raw() const noexcept { return std::span<const ViUInt16, CCS_SERIES_NUM_RAW_PIXELS>(buf_->raw); }
+
+    uint64_t sequence() const noexcept { return buf_->sequence; }
+    std::chrono::steady_clock::time_point time() const noexcept { return buf_->time; }
+    ViReal64 integration_time() const noexcept { return buf_->integrationTime; }
+
+    FrameBuffer &buffer() noexcept { return *buf_; }
+
+private:
+    friend class FramePool;
+    Frame(FrameBuffer *buf, FramePool *pool) noexcept : buf_(buf), pool_(pool) {}
+    inline void release() noexcept;
+
+    FrameBuffer *buf_ = nullptr;
+    FramePool *pool_ = nullptr;
+};
+
+/* A fixed number of frame buffers, all allocated up front. Frames may be
+ * released from any thread. The pool has to outlive its frames. */
+class FramePool {
+public:
+    explicit FramePool(size_t count) : buffers_(std::make_unique<FrameBuffer[]>(count)) {
+        free_.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            free_.push_back(&buffers_[i]);
+        }
+    }
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // an empty frame if all are in use
+    Frame acquire() noexcept {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (free_.empty()) {
+            return Frame();
+        }
+        FrameBuffer *buf = free_.back();
+        free_.pop_back();
+        return Frame(buf, this);
+    }
+
+    size_t available() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_.size();
+    }
+
+private:
+    friend class Frame;
+
+    void release(FrameBuffer *buf) noexcept {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // never reallocates, the capacity covers every buffer
+        free_.push_back(buf);
+    }
+
+    std::unique_ptr<FrameBuffer[]> buffers_;
+    std::vector<FrameBuffer *> free_;
+    mutable std::mutex mutex_;
+};
+
+inline void Frame::release() noexcept {
+    if (buf_) {
+        pool_->release(buf_);
+        buf_ = nullptr;
+        pool_ = nullptr;
+    }
+}
+
+
+/* An open spectrometer; closed when destroyed. Not for use from several
+ * threads at once, frames it returned are. Frames have to be destroyed
+ * before the device, they live in its pool. */
+class Device {
+public:
+    static constexpr size_t DEFAULT_FRAMES = 8;
+
+    // resource names of the attached spectrometers, for the constructor
+    static std::vector<std::string> find() {
+        ViUInt32 n = 0;
+        ViChar name[CCS_SERIES_BUFFER_SIZE];
+        std::vector<std::string> names;
+
+        check(VI_NULL, CCSseries_findRsrc(&n));
+        for (ViUInt32 i = 0; i < n; i++) {
+            check(VI_NULL, CCSseries_getRsrcName(i, name));
+            names.emplace_back(name);
+        }
+        return names;
+    }
+
+    // opens and initializes the device; frames is how many may be held at once
+    explicit Device(const std::string &resource, size_t frames = DEFAULT_FRAMES, bool idQuery = true, bool reset = false)
+        : pool_(std::make_unique<FramePool>(frames)) {
+        check(VI_NULL, CCSseries_init(const_cast<ViRsrc>(resource.c_str()), idQuery, reset, &instr_));
+        intTime_ = CCS_SERIES_DEF_INT_TIME;
+    }
+
+    // takes over a session opened with CCSseries_init
+    static Device adopt(ViSession instr, size_t frames = DEFAULT_FRAMES) { return Device(instr, frames); }
+
+    // frames of a moved device stay valid, the pool moves along
+    Device(Device &&o) noexcept
+        : instr_(std::exchange(o.instr_, VI_NULL)), pool_(std::move(o.pool_)), sequence_(o.sequence_), intTime_(o.intTime_),
+          restart_(o.restart_) {}
+    Device &operator=(Device &&o) noexcept {
+        if (this != &o) {
+            close();
+            instr_ = std::exchange(o.instr_, VI_NULL);
+            pool_ = std::move(o.pool_);
+            sequence_ = o.sequence_;
+            intTime_ = o.intTime_;
+            restart_ = o.restart_;
+        }
+        return *this;
+    }
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+    ~Device() { close(); }
+
+    ViSession handle() const noexcept { return instr_; }
+    FramePool &pool() noexcept { return *pool_; }
+
+    /* The device ends its scan mode with a new integration time and the
+     * driver discards scans taken with the old one. A continuous mode is
+     * started again; after a single shot one has to start the next. */
+    void set_integration_time(ViReal64 seconds) {
+        check(instr_, CCSseries_setIntegrationTime(instr_, seconds));
+        intTime_ = seconds;
+        if (restart_) {
+            check(instr_, restart_(instr_));
+        }
+    }
+
+    ViReal64 integration_time() const noexcept { return intTime_; }
+
+    void start_scan() { start(CCSseries_startScan, nullptr); }
+    void start_continuous() { start(CCSseries_startScanCont, CCSseries_startScanCont); }
+    void start_ext_trigger() { start(CCSseries_startScanExtTrg, nullptr); }
+    void start_continuous_ext_trigger() { start(CCSseries_startScanContExtTrg, CCSseries_startScanContExtTrg); }
+
+    // waits for the next scan; throws std::length_error if every frame is held
+    Frame read() {
+        Frame f = acquire();
+
+        check(instr_, CCSseries_getScanDataAndRaw(instr_, f.buffer().raw, f.buffer().data));
+        stamp(f);
+        return f;
+    }
+
+    // the next scan if one is buffered, else an empty frame; see CCSseries_tryGetScanData
+    Frame try_read() {
+        Frame f = acquire();
+        ViStatus err = CCSseries_tryGetScanDataAndRaw(instr_, f.buffer().raw, f.buffer().data);
+
+        check(instr_, err);
+        if (err == VI_SUCCESS_QUEUE_EMPTY) {
+            return Frame();
+        }
+        stamp(f);
+        return f;
+    }
+
+private:
+    // keeps intTime_ and restart_ up to date from its event loop, see ccsasync.hpp
+    friend class Spectrometer;
+
+    Device(ViSession instr, size_t frames) : instr_(instr), pool_(std::make_unique<FramePool>(frames)), intTime_(CCS_SERIES_DEF_INT_TIME) {}
+
+    using StartFn = ViStatus (*)(ViSession);
+
+    void start(StartFn fn, StartFn restart) {
+        restart_ = nullptr;
+        check(instr_, fn(instr_));
+        restart_ = restart;
+    }
+
+    Frame acquire() {
+        Frame f = pool_->acquire();
+
+        if (!f) {
+            throw std::length_error("ccs::Device: all frames in use");
+        }
+        return f;
+    }
+
+    // from the driver, which saw the scan arrive; steady_clock is CLOCK_MONOTONIC on Linux
+    void stamp(Frame &f) noexcept {
+        ViReal64 arrival = 0.0;
+        ViReal64 intTime = 0.0;
+        ViUInt32 lost = 0;
+
+        CCSseries_getScanInfo(instr_, &arrival, &lost, &intTime);
+        sequence_ += lost;
+        f.buffer().sequence = sequence_++;
+        f.buffer().time = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(arrival)));
+        f.buffer().integrationTime = intTime;
+    }
+
+    void close() noexcept {
+        if (instr_) {
+            CCSseries_close(instr_);
+            instr_ = VI_NULL;
+        }
+    }
+
+    ViSession instr_ = VI_NULL;
+    std::unique_ptr<FramePool> pool_;
+    uint64_t sequence_ = 0;
+    ViReal64 intTime_ = 0.0;
+    StartFn restart_ = nullptr;     // continuous mode to take up again, see set_integration_time
+};
+
+} // namespace ccs
+
+#endif
@@ -0,0 +1,435 @@
+/* C++20 coroutine interface for CCS series spectrometers.
+ *
+ * Lets a single-threaded program wait for scans of several spectrometers
+ * alongside its other I/O without a thread per device:
+ *
+ *     ccs::Task<void> acquire(ccs::Spectrometer &spec) {
+ *         co_await spec.set_integration_time(0.01);
+ *         co_await spec.start_continuous();
+ *         for (;;) {
+ *             ccs::Frame f = co_await spec.next_frame();
+ *             ...
+ *         }
+ *     }
+ *
+ *     ccs::EventLoop loop;
+ *     ccs::Spectrometer spec(loop, ccs::Spectrometer::find().at(0));
+ *     loop.spawn(acquire(spec));
+ *     loop.run();
+ *
+ * Coroutine parameters are copied into the coroutine, the captures of a
+ * lambda coroutine are not: a capturing lambda has to outlive its task.
+ *
+ * A Spectrometer is a ccs::Device (ccs.hpp) driven from the loop; its
+ * frames come from the device's pool. Scans come from the driver's read
+ * ahead: next_frame suspends on the descriptor of CCSseries_getScanEventFd
+ * until CCSseries_tryGetScanDataAndRaw has one. Control requests and EEPROM
+ * reads have no asynchronous USB path, so the bare driver call runs on a
+ * short-lived helper thread and the coroutine resumes on the loop when it is
+ * done; the Device is only touched from the loop. Do not start two of them
+ * on one spectrometer at the same time. Driver errors are thrown as
+ * ccs::Error.
+ *
+ * The loop is a plain epoll set. Another event loop can drive it by polling
+ * EventLoop::fd() and calling EventLoop::poll(0) when it is readable.
+ * Header only; link the driver library as for the C API. */
+#ifndef __ccsasync_hpp__
+#define __ccsasync_hpp__
+
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "vitypes.h"
+#include "CCS_Series_Drv.h"
+#include "ccs.hpp"
+
+namespace ccs {
+
+template <typename T> class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // hand control straight back to whoever awaited the task
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> c = h.promise().continuation;
+            return c ? c : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T> struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+    template <typename U> void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <> struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+/* A lazily started coroutine with one result, run by co_await-ing it or by
+ * EventLoop::spawn. */
+template <typename T> class Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> h) noexcept : h_(h) {}
+    Task(Task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task &operator=(Task &&o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> h_;
+};
+
+template <typename T> Task<T> detail::Promise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::Promise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+
+class EventLoop {
+public:
+    EventLoop() : ep_(epoll_create1(EPOLL_CLOEXEC)) {
+        if (ep_ < 0) throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+    ~EventLoop() { close(ep_); }
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // suspends until fd is readable; one waiter per descriptor at a time
+    auto readable(int fd) {
+        struct Awaiter {
+            EventLoop &loop;
+            int fd;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { loop.watch(fd, h); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, fd};
+    }
+
+    // runs t on this loop; its exception, if any, is rethrown by run or poll
+    void spawn(Task<void> t) { detach(std::move(t)); }
+
+    // the epoll descriptor, readable when poll has something to do
+    int fd() const noexcept { return ep_; }
+
+    // resumes the coroutines whose descriptors became ready within timeout ms
+    // (-1 waits); returns how many
+    int poll(int timeout) {
+        epoll_event ev[16];
+        int n = epoll_wait(ep_, ev, 16, timeout);
+
+        if (n < 0) {
+            if (errno == EINTR) return 0;
+            throw std::system_error(errno, std::generic_category(), "epoll_wait");
+        }
+        for (int i = 0; i < n; i++) {
+            auto it = waiting_.find(ev[i].data.fd);
+            if (it != waiting_.end()) {
+                std::coroutine_handle<> h = it->second;
+                waiting_.erase(it);
+                h.resume();
+            }
+        }
+        rethrow();
+        return n;
+    }
+
+    // until every spawned task has finished
+    void run() {
+        while (tasks_ && !waiting_.empty()) {
+            poll(-1);
+        }
+        rethrow();
+    }
+
+private:
+    // self-destroying wrapper that owns a spawned task
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    Detached detach(Task<void> t) {
+        tasks_++;
+        try {
+            co_await t;
+        } catch (...) {
+            if (!error_) error_ = std::current_exception();
+        }
+        tasks_--;
+    }
+
+    void watch(int fd, std::coroutine_handle<> h) {
+        epoll_event ev = {};
+
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = fd;
+        // a one shot descriptor stays in the set, disarmed, after it fired
+        if (epoll_ctl(ep_, EPOLL_CTL_MOD, fd, &ev) && ((errno != ENOENT) || epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev))) {
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+        waiting_[fd] = h;
+    }
+
+    void forget(int fd) {
+        epoll_ctl(ep_, EPOLL_CTL_DEL, fd, nullptr);
+        waiting_.erase(fd);
+    }
+
+    void rethrow() {
+        if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+    friend class Spectrometer;
+    template <typename F> friend Task<ViStatus> offload(EventLoop &loop, F f);
+
+    int ep_;
+    std::unordered_map<int, std::coroutine_handle<>> waiting_;
+    int tasks_ = 0;
+    std::exception_ptr error_;
+};
+
+
+/* Runs the blocking call f on a helper thread and resumes on the loop with
+ * its status once it returned. */
+template <typename F> Task<ViStatus> offload(EventLoop &loop, F f) {
+    int done = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ViStatus status = VI_SUCCESS;
+
+    if (done < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+
+    std::thread worker([&status, &f, done] {
+        uint64_t one = 1;
+
+        status = f();
+        if (write(done, &one, sizeof(one)) < 0) {
+            // cannot fail on a fresh eventfd
+        }
+    });
+    try {
+        co_await loop.readable(done);
+    } catch (...) {
+        worker.join();
+        close(done);
+        throw;
+    }
+    worker.join();
+    loop.forget(done);
+    close(done);
+    co_return status;
+}
+
+
+/* An open spectrometer; closed when destroyed. */
+class Spectrometer {
+public:
+    // resource names of the attached spectrometers, for the constructor
+    static std::vector<std::string> find() { return Device::find(); }
+
+    // opens and initializes the device, blocking while it reads the calibration
+    Spectrometer(EventLoop &loop, const std::string &resource, size_t frames = Device::DEFAULT_FRAMES, bool idQuery = true, bool reset = false)
+        : loop_(&loop), dev_(resource, frames, idQuery, reset) {}
+
+    // same without blocking the loop
+    static Task<Spectrometer> open(EventLoop &loop, std::string resource, size_t frames = Device::DEFAULT_FRAMES, bool idQuery = true, bool reset = false) {
+        ViSession instr = VI_NULL;
+        ViStatus err = co_await offload(loop, [&] {
+            return CCSseries_init(const_cast<ViRsrc>(resource.c_str()), idQuery, reset, &instr);
+        });
+
+        check(VI_NULL, err);
+        co_return Spectrometer(loop, Device::adopt(instr, frames));
+    }
+
+    Spectrometer(Spectrometer &&o) noexcept
+        : loop_(o.loop_), dev_(std::move(o.dev_)), eventFd_(std::exchange(o.eventFd_, -1)) {}
+    Spectrometer &operator=(Spectrometer &&o) noexcept {
+        if (this != &o) {
+            forget();
+            loop_ = o.loop_;
+            dev_ = std::move(o.dev_);
+            eventFd_ = std::exchange(o.eventFd_, -1);
+        }
+        return *this;
+    }
+    Spectrometer(const Spectrometer &) = delete;
+    Spectrometer &operator=(const Spectrometer &) = delete;
+    ~Spectrometer() { forget(); }
+
+    ViSession handle() const noexcept { return dev_.handle(); }
+    Device &device() noexcept { return dev_; }
+
+    // the next scan; the device has to be scanning, see start_continuous
+    Task<Frame> next_frame() {
+        Frame f;
+
+        while (!(f = dev_.try_read())) {
+            co_await loop_->readable(event_fd());
+        }
+        co_return f;
+    }
+
+    // same into the caller's array, processed data only
+    Task<void> next_frame(ViReal64 data[]) {
+        ViStatus err;
+
+        while ((err = CCSseries_tryGetScanData(handle(), data)) == VI_SUCCESS_QUEUE_EMPTY) {
+            co_await loop_->readable(event_fd());
+        }
+        check(handle(), err);
+    }
+
+    Task<void> start_continuous() { return start(CCSseries_startScanCont); }
+    Task<void> start_continuous_ext_trigger() { return start(CCSseries_startScanContExtTrg); }
+
+    // as Device::set_integration_time, a continuous mode is started again
+    Task<void> set_integration_time(ViReal64 seconds) {
+        ViSession instr = handle();
+        Device::StartFn restart = dev_.restart_;
+        ViStatus restarted = VI_SUCCESS;
+        ViStatus err = co_await offload(*loop_, [instr, seconds, restart, &restarted] {
+            ViStatus err = CCSseries_setIntegrationTime(instr, seconds);
+
+            if ((err >= 0) && restart) restarted = restart(instr);
+            return err;
+        });
+
+        check(instr, err);
+        dev_.intTime_ = seconds;
+        check(instr, restarted);
+    }
+
+    // as read back from the device
+    Task<ViReal64> integration_time() {
+        ViSession instr = handle();
+        ViReal64 t = 0.0;
+
+        check(instr, co_await offload(*loop_, [instr, &t] { return CCSseries_getIntegrationTime(instr, &t); }));
+        co_return t;
+    }
+
+    // EEPROM reads
+
+    Task<std::string> user_text() {
+        ViSession instr = handle();
+        ViChar text[CCS_SERIES_MAX_USER_NAME_SIZE + 1] = {0};
+
+        check(instr, co_await offload(*loop_, [instr, &text] { return CCSseries_getUserText(instr, text); }));
+        co_return std::string(text);
+    }
+
+    // amplitude correction factors stored in the device, not the ones in use
+    Task<std::vector<ViReal64>> stored_amplitude_data() {
+        ViSession instr = handle();
+        std::vector<ViReal64> acor(CCS_SERIES_NUM_PIXELS);
+
+        check(instr, co_await offload(*loop_, [instr, &acor] {
+            return CCSseries_getAmplitudeData(instr, acor.data(), 0, CCS_SERIES_NUM_PIXELS, ACOR_FROM_NVMEM);
+        }));
+        co_return acor;
+    }
+
+private:
+    Spectrometer(EventLoop &loop, Device &&dev) noexcept : loop_(&loop), dev_(std::move(dev)) {}
+
+    // a continuous mode fn, remembered by the device once it runs
+    Task<void> start(Device::StartFn fn) {
+        ViSession instr = handle();
+
+        dev_.restart_ = nullptr;
+        check(instr, co_await offload(*loop_, [instr, fn] { return fn(instr); }));
+        dev_.restart_ = fn;
+    }
+
+    int event_fd() {
+        ViInt32 fd = -1;
+
+        if (eventFd_ < 0) {
+            check(handle(), CCSseries_getScanEventFd(handle(), &fd));
+            eventFd_ = (int)fd;
+        }
+        return eventFd_;
+    }
+
+    // the driver closes the descriptor with the device, the loop must not keep it
+    void forget() noexcept {
+        if (eventFd_ >= 0) {
+            loop_->forget(eventFd_);
+            eventFd_ = -1;
+        }
+    }
+
+    EventLoop *loop_;
+    Device dev_;
+    int eventFd_ = -1;
+};
+
+} // namespace ccs
+
+#endif
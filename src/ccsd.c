@@ -0,0 +1,478 @@
+// ccsd: local acquisition daemon
+//
+// Owns one spectrometer, CCS series or SP1/SP2-USB as picked from its
+// vid:pid, keeps it streaming and serves any number of local clients over
+// a Unix domain socket (protocol in ccsd.h). Opening the device once here
+// saves every client the init cycle and lets monitoring tools and
+// experiments share it, which the exclusive USB claim otherwise prevents.
+
+#define _GNU_SOURCE     // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "CCS_Series_Drv.h"
+#include "ccsstream.h"
+#include "ccsd.h"
+
+#define MAX_CLIENTS     32
+#define OUT_LIMIT       (4 * 1024 * 1024)   // queued bytes per client before its batches are dropped
+#define FRAME_BYTES     (sizeof(ccsd_frame_t) + npix * sizeof(double))
+#define MAX_FRAME_BYTES (sizeof(ccsd_frame_t) + CCS_SERIES_NUM_PIXELS * sizeof(double))
+#define MAX_BATCH       ((OUT_LIMIT - sizeof(ccsd_msg_t)) / FRAME_BYTES)    // larger batches never fit below OUT_LIMIT
+
+struct client {
+    int fd;
+    int subscribed;
+    int snapshot;               // wants the next frame
+    uint32_t batch;             // frames per batch
+    uint32_t dropped;
+    int setint;                 // SETINT_* of an integration time request
+    double setval;
+
+    char *bbuf;                 // batch being collected: ccsd_msg_t followed by frames
+    uint32_t nbatch;
+
+    char *out;                  // bytes waiting for the socket
+    size_t outlen, outoff, outcap;
+
+    ccsd_req_t req;             // partially received request
+    size_t reqlen;
+};
+
+// integration time requests wait in the client until the worker is free
+#define SETINT_NONE     0
+#define SETINT_QUEUED   1
+#define SETINT_APPLYING 2
+
+static struct client clients[MAX_CLIENTS];
+static int nclients = 0;
+static int applying = 0;        // a request is with the worker, its client may have left
+static const ccs_stream_ops_t *family;     // driver of the device served, from its vid:pid
+static uint32_t npix;                       // pixels per frame of that device
+static double wavdata[CCS_SERIES_NUM_PIXELS];
+static volatile sig_atomic_t stopreq = 0;
+
+
+static void onsignal(int sig) {
+    stopreq = 1;
+}
+
+
+void usage(char *prog) {
+    fprintf(stderr, "usage: %s [-S socket] [-i inttime] [-a average] [-r prio] [-c cpus] [-l] vid:pid\n", prog);
+    fprintf(stderr, "  -r prio     run the acquisition thread under SCHED_FIFO at this priority\n");
+    fprintf(stderr, "  -c cpus     mask of the CPUs the acquisition thread may use, e.g. 0x4\n");
+    fprintf(stderr, "  -l          lock the process memory\n");
+}
+
+
+void showerr(unsigned long inst, int retcode, char* funcname) {
+    char errdesc[CCS_SERIES_ERR_DESCR_BUFFER_SIZE];
+    family->errorMessage(inst, retcode, errdesc);
+    fprintf(stderr, "%s returned %d: %s\n", funcname, retcode, errdesc);
+}
+
+
+static void msg_init(ccsd_msg_t *m, uint32_t type, int32_t status, ccs_stream_t *strm) {
+    memset(m, 0, sizeof(*m));
+    m->magic = CCSD_MAGIC;
+    m->type = type;
+    m->status = status;
+    m->npix = npix;
+    m->intTime = CCSstream_getIntegrationTime(strm);
+}
+
+
+// queue bytes for the client; replies always fit, frame batches only below OUT_LIMIT
+static int queue_out(struct client *c, const void *data, size_t len, int force) {
+    size_t need;
+    char *p;
+
+    if (c->outoff == c->outlen) {
+        c->outoff = c->outlen = 0;
+    }
+    if (!force && (c->outlen - c->outoff + len > OUT_LIMIT)) {
+        return -1;
+    }
+    need = c->outlen + len;
+    if (need > c->outcap) {
+        if (c->outoff) {
+            memmove(c->out, c->out + c->outoff, c->outlen - c->outoff);
+            c->outlen -= c->outoff;
+            c->outoff = 0;
+            need = c->outlen + len;
+        }
+        if (need > c->outcap) {
+            if (!(p = realloc(c->out, need))) {
+                return -1;
+            }
+            c->out = p;
+            c->outcap = need;
+        }
+    }
+    memcpy(c->out + c->outlen, data, len);
+    c->outlen += len;
+    return 0;
+}
+
+
+static void flush_out(struct client *c) {
+    ssize_t n;
+
+    while (c->outoff < c->outlen) {
+        n = send(c->fd, c->out + c->outoff, c->outlen - c->outoff, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;     // EAGAIN waits for POLLOUT, real errors show up as POLLHUP/POLLERR
+        }
+        c->outoff += n;
+    }
+}
+
+
+static void drop_client(int i) {
+    struct client *c = &clients[i];
+
+    close(c->fd);
+    free(c->bbuf);
+    free(c->out);
+    clients[i] = clients[--nclients];
+}
+
+
+static void reply(struct client *c, int32_t status, ccs_stream_t *strm) {
+    ccsd_msg_t m;
+
+    msg_init(&m, CCSD_MSG_ACK, status, strm);
+    queue_out(c, &m, sizeof(m), 1);
+}
+
+
+static void handle_request(struct client *c, ccs_stream_t *strm) {
+    ccsd_msg_t m;
+    uint32_t batch;
+    char *p;
+
+    if (c->req.magic != CCSD_MAGIC) {
+        reply(c, VI_ERROR_INV_PARAMETER, strm);
+        return;
+    }
+    switch (c->req.cmd) {
+    case CCSD_CMD_INFO:
+        msg_init(&m, CCSD_MSG_INFO, VI_SUCCESS, strm);
+        queue_out(c, &m, sizeof(m), 1);
+        queue_out(c, wavdata, npix * sizeof(double), 1);
+        break;
+
+    case CCSD_CMD_SUBSCRIBE:
+        // also rejects NaN, before the conversion could overflow
+        if (!(c->req.arg <= MAX_BATCH)) {
+            reply(c, VI_ERROR_INV_PARAMETER, strm);
+            break;
+        }
+        batch = (c->req.arg >= 1.0) ? (uint32_t)c->req.arg : 1;
+        if (!(p = realloc(c->bbuf, sizeof(ccsd_msg_t) + batch * FRAME_BYTES))) {
+            reply(c, VI_ERROR_SYSTEM_ERROR, strm);
+            break;
+        }
+        c->bbuf = p;
+        c->batch = batch;
+        c->nbatch = 0;
+        c->dropped = 0;
+        c->subscribed = 1;
+        reply(c, VI_SUCCESS, strm);
+        break;
+
+    case CCSD_CMD_UNSUBSCRIBE:
+        c->subscribed = 0;
+        c->nbatch = 0;
+        reply(c, VI_SUCCESS, strm);
+        break;
+
+    case CCSD_CMD_SETINT:
+        // the worker only takes it between scans, which can be long;
+        // answered from the loop once the stream fd says it was applied
+        if (c->setint != SETINT_NONE) {
+            reply(c, VI_ERROR_RSRC_BUSY, strm);
+            break;
+        }
+        c->setint = SETINT_QUEUED;
+        c->setval = c->req.arg;
+        break;
+
+    case CCSD_CMD_SNAPSHOT:
+        c->snapshot = 1;
+        break;
+
+    default:
+        reply(c, VI_ERROR_INV_PARAMETER, strm);
+        break;
+    }
+}
+
+
+// returns -1 once the client hung up
+static int read_requests(struct client *c, ccs_stream_t *strm) {
+    ssize_t n;
+
+    for (;;) {
+        n = recv(c->fd, (char *)&c->req + c->reqlen, sizeof(c->req) - c->reqlen, MSG_DONTWAIT);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        c->reqlen += n;
+        if (c->reqlen == sizeof(c->req)) {
+            handle_request(c, strm);
+            c->reqlen = 0;
+        }
+    }
+}
+
+
+static void put_frame(char *dst, const ccs_frame_t *frame) {
+    ccsd_frame_t fh;
+
+    fh.seq = frame->seq;
+    fh.navg = frame->navg;
+    fh.stamp = frame->stamp.tv_sec + frame->stamp.tv_nsec * 1e-9;
+    memcpy(dst, &fh, sizeof(fh));
+    memcpy(dst + sizeof(fh), frame->data, frame->npix * sizeof(double));
+}
+
+
+static void distribute(const ccs_frame_t *frame, ccs_stream_t *strm) {
+    struct client *c;
+    ccsd_msg_t m;
+    char snap[sizeof(ccsd_msg_t) + MAX_FRAME_BYTES];
+    int i;
+
+    for (i = 0; i < nclients; i++) {
+        c = &clients[i];
+        if (c->snapshot) {
+            msg_init(&m, CCSD_MSG_FRAMES, VI_SUCCESS, strm);
+            m.count = 1;
+            memcpy(snap, &m, sizeof(m));
+            put_frame(snap + sizeof(m), frame);
+            queue_out(c, snap, sizeof(m) + FRAME_BYTES, 1);
+            c->snapshot = 0;
+        }
+        if (!c->subscribed) {
+            continue;
+        }
+        put_frame(c->bbuf + sizeof(ccsd_msg_t) + c->nbatch * FRAME_BYTES, frame);
+        if (++c->nbatch < c->batch) {
+            continue;
+        }
+        // batch complete: one header and one send for all its frames
+        msg_init(&m, CCSD_MSG_FRAMES, VI_SUCCESS, strm);
+        m.count = c->nbatch;
+        m.dropped = c->dropped;
+        memcpy(c->bbuf, &m, sizeof(m));
+        if (queue_out(c, c->bbuf, sizeof(m) + c->nbatch * FRAME_BYTES, 0)) {
+            c->dropped += c->nbatch;    // client is not keeping up
+        } else {
+            c->dropped = 0;
+        }
+        c->nbatch = 0;
+    }
+}
+
+
+// answers the request the worker took and hands it the next one
+static void advance_setint(ccs_stream_t *strm) {
+    ViStatus ret;
+    int i;
+
+    if (applying) {
+        if ((ret = CCSstream_integrationTimeApplied(strm)) == VI_ERROR_TMO) {
+            return;
+        }
+        applying = 0;
+        for (i = 0; i < nclients; i++) {
+            if (clients[i].setint == SETINT_APPLYING) {
+                clients[i].setint = SETINT_NONE;
+                reply(&clients[i], ret, strm);
+            }
+        }
+    }
+    for (i = 0; i < nclients; i++) {
+        if (clients[i].setint != SETINT_QUEUED) {
+            continue;
+        }
+        if ((ret = CCSstream_requestIntegrationTime(strm, clients[i].setval))) {
+            clients[i].setint = SETINT_NONE;
+            reply(&clients[i], ret, strm);
+            continue;
+        }
+        clients[i].setint = SETINT_APPLYING;
+        applying = 1;
+        return;
+    }
+}
+
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 8)) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+int main(int argc, char* argv[]) {
+    unsigned long inst;
+    ViStatus ret;
+    ccs_stream_cfg_t cfg = { 0 };
+    ccs_stream_t *strm;
+    ccs_frame_t *frame;
+    struct pollfd pfd[MAX_CLIENTS + 2];
+    char *path = CCSD_SOCKET;
+    int lfd, fd, opt, i, n;
+    int failed = 0;
+
+    while ((opt = getopt(argc, argv, "S:i:a:r:c:lh")) != -1) {
+        switch (opt) {
+        case 'S': path = optarg; break;
+        case 'i': cfg.intTime = atof(optarg); break;
+        case 'a': cfg.average = strtoul(optarg, NULL, 0); break;
+        case 'r': cfg.rtPriority = atoi(optarg); break;
+        case 'c': cfg.cpus = strtoul(optarg, NULL, 0); break;
+        case 'l': cfg.lockMemory = VI_TRUE; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, onsignal);
+    signal(SIGTERM, onsignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    family = CCSstream_opsFor(argv[optind]);
+    npix = family->npix;
+    cfg.ops = family;
+    ret = family->open(argv[optind], &inst);
+    if (ret) {
+        showerr(inst, ret, "init");
+        return 1;
+    }
+    ret = family->getWavelengthData(inst, wavdata);
+    if (ret) {
+        showerr(inst, ret, "getwldata");
+        family->close(inst);
+        return 1;
+    }
+    if ((lfd = open_socket(path)) < 0) {
+        family->close(inst);
+        return 1;
+    }
+    ret = CCSstream_start(inst, &cfg, &strm);
+    if (ret) {
+        showerr(inst, ret, "streamstart");
+        close(lfd);
+        unlink(path);
+        family->close(inst);
+        return 1;
+    }
+    fprintf(stderr, "serving %s on %s\n", argv[optind], path);
+
+    while (!stopreq) {
+        pfd[0].fd = lfd;
+        pfd[0].events = (nclients < MAX_CLIENTS) ? POLLIN : 0;
+        pfd[1].fd = CCSstream_fd(strm);
+        pfd[1].events = POLLIN;
+        for (i = 0; i < nclients; i++) {
+            pfd[i + 2].fd = clients[i].fd;
+            pfd[i + 2].events = POLLIN | ((clients[i].outoff < clients[i].outlen) ? POLLOUT : 0);
+        }
+        n = nclients;
+
+        if (poll(pfd, n + 2, 500) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            failed = 1;
+            break;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            CCSstream_clearFd(strm);
+            while (!(ret = CCSstream_next(strm, &frame, 0))) {
+                distribute(frame, strm);
+                CCSstream_release(strm, frame);
+            }
+            if (ret != VI_ERROR_TMO) {
+                showerr(inst, ret, "stream");
+                failed = 1;
+                break;
+            }
+        }
+
+        // walk backwards, drop_client moves the last client into the freed spot
+        for (i = n - 1; i >= 0; i--) {
+            if (pfd[i + 2].revents & POLLIN) {
+                if (read_requests(&clients[i], strm)) {
+                    drop_client(i);
+                    continue;
+                }
+            } else if (pfd[i + 2].revents & (POLLHUP | POLLERR)) {
+                drop_client(i);
+                continue;
+            }
+        }
+        advance_setint(strm);
+        for (i = 0; i < nclients; i++) {
+            flush_out(&clients[i]);
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0) {
+                memset(&clients[nclients], 0, sizeof(struct client));
+                clients[nclients++].fd = fd;
+            }
+        }
+    }
+
+    while (nclients) {
+        drop_client(nclients - 1);
+    }
+    close(lfd);
+    unlink(path);
+
+    ret = CCSstream_stop(strm);
+    if (ret) {
+        showerr(inst, ret, "streamstop");
+        failed = 1;
+    }
+    family->close(inst);
+    // a supervisor has to tell a device failure from a requested stop
+    return failed;
+}
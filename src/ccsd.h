@@ -0,0 +1,51 @@
+/* Wire protocol of ccsd, the local acquisition daemon.
+ *
+ * ccsd owns one spectrometer and streams it continuously. Clients connect
+ * to its Unix domain socket (stream type) and send fixed-size requests;
+ * the daemon answers each request with a message, and sends subscribers
+ * batches of frames as they arrive. All fields are in host byte order. */
+#ifndef __ccsd_h__
+#define __ccsd_h__
+
+#include <stdint.h>
+
+#define CCSD_SOCKET         "/tmp/ccsd.sock"
+#define CCSD_MAGIC          0x43435344u     // "CCSD"
+
+// requests
+#define CCSD_CMD_INFO           1   // -> CCSD_MSG_INFO
+#define CCSD_CMD_SUBSCRIBE      2   // arg = frames per batch (0 = 1, at most 4 MiB of frames,
+                                    // 143 for a CCS, 174 for an SPx) -> CCSD_MSG_ACK, then CCSD_MSG_FRAMES
+#define CCSD_CMD_UNSUBSCRIBE    3   // -> CCSD_MSG_ACK
+#define CCSD_CMD_SETINT         4   // arg = integration time in s -> CCSD_MSG_ACK once applied,
+                                    // VI_ERROR_RSRC_BUSY while the client's previous one is pending
+#define CCSD_CMD_SNAPSHOT       5   // -> CCSD_MSG_FRAMES with the next frame
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    cmd;
+    double      arg;
+} ccsd_req_t;
+
+// messages
+#define CCSD_MSG_ACK            1   // status only
+#define CCSD_MSG_INFO           2   // npix wavelengths follow
+#define CCSD_MSG_FRAMES         3   // count times (ccsd_frame_t, npix doubles) follow
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    type;
+    int32_t     status;             // ViStatus of the request, 0 on success
+    uint32_t    npix;
+    uint32_t    count;              // frames in a CCSD_MSG_FRAMES message
+    uint32_t    dropped;            // frames this client missed since its last batch
+    double      intTime;            // current integration time in s
+} ccsd_msg_t;
+
+typedef struct {
+    uint32_t    seq;
+    uint32_t    navg;
+    double      stamp;              // CLOCK_MONOTONIC seconds on the daemon's host
+} ccsd_frame_t;
+
+#endif
@@ -0,0 +1,239 @@
+/* Scan processing kernels generated per sensor geometry.
+ *
+ * Every spectrometer family turns a raw scan into normalized data the same
+ * way: subtract the dark level taken from the shielded pixels, normalize to
+ * the ADC range left above it and apply the amplitude correction. What
+ * differs is where the pixels sit in the words the device sends.
+ * CCS_GEOM_KERNELS expands to the kernels of one geometry with all offsets
+ * and lengths as constants, so each family gets fixed trip count loops the
+ * compiler can unroll and vectorize. Adding a family leaves the kernels of
+ * the others untouched:
+ *
+ *     CCS_GEOM_KERNELS(CCSseries, 3694, 16, 12, 32, 3648, 0xFFFF, CCS_GEOM_FORWARD)
+ *
+ * Parameters, all integer constant expressions:
+ *     name      prefix of the generated functions
+ *     rawLen    words per raw scan
+ *     darkOff   raw position of the first dark pixel
+ *     darkCnt   number of dark pixels, even
+ *     scanOff   raw position of the first effective pixel
+ *     numPix    number of effective pixels, even
+ *     maxAdc    full scale ADC value
+ *     layout    CCS_GEOM_FORWARD or CCS_GEOM_REVERSED_INVERTED
+ *
+ * Dark values come in two slots: slot 0 for the raw positions of the same
+ * parity as darkOff, slot 1 for the others. Which slot an output pixel uses
+ * follows from the raw position it is read from, so a reversed readout or
+ * an odd scanOff needs no parameter of its own.
+ *
+ * Generated, all static inline:
+ *     void name_darkSums(const ViUInt16 raw[], ViUInt32 sum[2])
+ *         per slot sum of the darkCnt / 2 dark pixels, inverted with the layout
+ *     void name_procCommon(const ViUInt16 raw[], const ViReal64 gain[],
+ *                          const ViReal64 dark[], const ViReal64 norm[], ViReal64 data[])
+ *         dark[0] and norm[0] for all pixels; the gain only applies below full scale
+ *     void name_procEvenOdd(raw, gain, dark, norm, data)
+ *         dark and norm per slot
+ *     void name_procClamped(raw, gain, dark, norm, data)
+ *         same, results below zero clipped
+ *     void name_procClampedFlat(raw, dark, norm, data)
+ *         same without amplitude correction
+ *     void name_q16Common(const ViUInt16 raw[], const ViUInt32 gain[], const int64_t dark[],
+ *                         const int64_t recip[], int64_t ndark, ViInt32 data[])
+ *     void name_q16EvenOdd(raw, gain, dark, recip, ndark, data)
+ *     void name_q16Clamped(raw, gain, dark, recip, ndark, data)
+ *         fixed point versions of the above for Q16.16 gain and data; dark
+ *         holds the sums over ndark pixels per slot and recip the reciprocals
+ *         of the normalizing denominators in Q(CCS_GEOM_RECIP_SHIFT)
+ * data holds numPix values. The kernels have no branches in their loops. */
+#ifndef __ccsgeom_h__
+#define __ccsgeom_h__
+
+#include <stdint.h>
+#include "vitypes.h"
+
+#define CCS_GEOM_FORWARD            0   // pixels in order, counts rise with light
+#define CCS_GEOM_REVERSED_INVERTED  1   // last pixel first, counts fall with light
+
+#define CCS_GEOM_Q16_ONE            ((int64_t)1 << 16)
+#define CCS_GEOM_RECIP_SHIFT        40  // fraction bits of the Q16 kernel reciprocals
+
+// raw position of output pixel i
+#define CCS_GEOM_POS(layout, scanOff, numPix, i) \
+    ((layout) ? ((scanOff) + (numPix) - 1 - (i)) : ((scanOff) + (i)))
+
+// dark slot of output pixel 0; pixel i uses slot (CCS_GEOM_SLOT0 ^ (i & 1))
+#define CCS_GEOM_SLOT0(layout, darkOff, scanOff, numPix) \
+    ((CCS_GEOM_POS(layout, scanOff, numPix, 0) - (darkOff)) & 1)
+
+// raw value v below full scale
+#define CCS_GEOM_IN_RANGE(layout, maxAdc, v) \
+    ((layout) ? ((v) > 0) : ((v) < (maxAdc)))
+
+// signal of raw value v above dark level d
+#define CCS_GEOM_SIGNAL(layout, maxAdc, v, d) \
+    ((layout) ? (((ViReal64)(maxAdc) - (d)) - (ViReal64)(v)) : ((ViReal64)(v) - (d)))
+
+// same scaled by n, raw value v above dark sum d over n pixels
+#define CCS_GEOM_SIGNAL_Q(layout, maxAdc, v, d, n) \
+    ((layout) ? ((int64_t)(maxAdc) * (n) - (d) - (int64_t)(v) * (n)) : ((int64_t)(v) * (n) - (d)))
+
+// signal s normalized by reciprocal recip and amplified by Q16.16 gain g,
+// saturated to what Q16.16 can hold; only reachable with the one count range
+static inline ViInt32 ccsgeom_q16Scale(int64_t s, int64_t recip, ViUInt32 g)
+{
+    int64_t v = s * recip;
+
+    v = (v + ((int64_t)1 << (CCS_GEOM_RECIP_SHIFT - 17))) >> (CCS_GEOM_RECIP_SHIFT - 16);
+    v = (v * (int64_t)g + (CCS_GEOM_Q16_ONE >> 1)) >> 16;
+    v = (v > INT32_MAX) ? INT32_MAX : v;
+    v = (v < INT32_MIN) ? INT32_MIN : v;
+    return (ViInt32)v;
+}
+
+#define CCS_GEOM_KERNELS(name, rawLen, darkOff, darkCnt, scanOff, numPix, maxAdc, layout)                     \
+_Static_assert((((darkCnt) % 2) == 0) && (((numPix) % 2) == 0), #name ": pixel counts must be even");          \
+_Static_assert(((darkOff) + (darkCnt) <= (rawLen)) && ((scanOff) + (numPix) <= (rawLen)),                      \
+               #name ": pixels outside the raw scan");                                                        \
+                                                                                                              \
+static inline void name##_darkSums(const ViUInt16 raw[], ViUInt32 sum[2])                                     \
+{                                                                                                             \
+    ViUInt32 s0 = 0, s1 = 0;                                                                                  \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (darkCnt); i += 2) {                                                                      \
+        s0 += raw[(darkOff) + i];                                                                             \
+        s1 += raw[(darkOff) + i + 1];                                                                         \
+    }                                                                                                         \
+    if (layout) {                                                                                             \
+        s0 = (ViUInt32)(maxAdc) * ((darkCnt) / 2) - s0;                                                       \
+        s1 = (ViUInt32)(maxAdc) * ((darkCnt) / 2) - s1;                                                       \
+    }                                                                                                         \
+    sum[0] = s0;                                                                                              \
+    sum[1] = s1;                                                                                              \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_procCommon(const ViUInt16 raw[], const ViReal64 gain[], const ViReal64 dark[],      \
+                                     const ViReal64 norm[], ViReal64 data[])                                  \
+{                                                                                                             \
+    const ViReal64 d = dark[0];                                                                               \
+    const ViReal64 n = norm[0];                                                                               \
+    ViReal64 g;                                                                                               \
+    ViUInt16 v;                                                                                               \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i++) {                                                                          \
+        v = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        /* gain is loaded unconditionally so the selection compiles to a blend */                            \
+        g = gain[i];                                                                                          \
+        g = CCS_GEOM_IN_RANGE(layout, maxAdc, v) ? g : 1.0;                                                   \
+        data[i] = CCS_GEOM_SIGNAL(layout, maxAdc, v, d) * n * g;                                              \
+    }                                                                                                         \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_procEvenOdd(const ViUInt16 raw[], const ViReal64 gain[], const ViReal64 dark[],     \
+                                      const ViReal64 norm[], ViReal64 data[])                                 \
+{                                                                                                             \
+    const int s0 = CCS_GEOM_SLOT0(layout, darkOff, scanOff, numPix), s1 = s0 ^ 1;                             \
+    ViUInt16 a, b;                                                                                            \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i += 2) {                                                                       \
+        a = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        b = raw[CCS_GEOM_POS(layout, scanOff, numPix, i + 1)];                                                \
+        data[i]     = CCS_GEOM_SIGNAL(layout, maxAdc, a, dark[s0]) * norm[s0] * gain[i];                      \
+        data[i + 1] = CCS_GEOM_SIGNAL(layout, maxAdc, b, dark[s1]) * norm[s1] * gain[i + 1];                  \
+    }                                                                                                         \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_procClamped(const ViUInt16 raw[], const ViReal64 gain[], const ViReal64 dark[],     \
+                                      const ViReal64 norm[], ViReal64 data[])                                 \
+{                                                                                                             \
+    const int s0 = CCS_GEOM_SLOT0(layout, darkOff, scanOff, numPix), s1 = s0 ^ 1;                             \
+    ViReal64 v0, v1;                                                                                          \
+    ViUInt16 a, b;                                                                                            \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i += 2) {                                                                       \
+        a = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        b = raw[CCS_GEOM_POS(layout, scanOff, numPix, i + 1)];                                                \
+        v0 = CCS_GEOM_SIGNAL(layout, maxAdc, a, dark[s0]) * norm[s0] * gain[i];                               \
+        v1 = CCS_GEOM_SIGNAL(layout, maxAdc, b, dark[s1]) * norm[s1] * gain[i + 1];                           \
+        data[i]     = (v0 > 0.0) ? v0 : 0.0;                                                                  \
+        data[i + 1] = (v1 > 0.0) ? v1 : 0.0;                                                                  \
+    }                                                                                                         \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_procClampedFlat(const ViUInt16 raw[], const ViReal64 dark[], const ViReal64 norm[], \
+                                          ViReal64 data[])                                                    \
+{                                                                                                             \
+    const int s0 = CCS_GEOM_SLOT0(layout, darkOff, scanOff, numPix), s1 = s0 ^ 1;                             \
+    ViReal64 v0, v1;                                                                                          \
+    ViUInt16 a, b;                                                                                            \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i += 2) {                                                                       \
+        a = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        b = raw[CCS_GEOM_POS(layout, scanOff, numPix, i + 1)];                                                \
+        v0 = CCS_GEOM_SIGNAL(layout, maxAdc, a, dark[s0]) * norm[s0];                                         \
+        v1 = CCS_GEOM_SIGNAL(layout, maxAdc, b, dark[s1]) * norm[s1];                                         \
+        data[i]     = (v0 > 0.0) ? v0 : 0.0;                                                                  \
+        data[i + 1] = (v1 > 0.0) ? v1 : 0.0;                                                                  \
+    }                                                                                                         \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_q16Common(const ViUInt16 raw[], const ViUInt32 gain[], const int64_t dark[],        \
+                                    const int64_t recip[], int64_t ndark, ViInt32 data[])                     \
+{                                                                                                             \
+    const int64_t d = dark[0];                                                                                \
+    const int64_t r = recip[0];                                                                               \
+    ViUInt32 g;                                                                                               \
+    ViUInt16 v;                                                                                               \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i++) {                                                                          \
+        v = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        g = gain[i];                                                                                          \
+        g = CCS_GEOM_IN_RANGE(layout, maxAdc, v) ? g : (ViUInt32)CCS_GEOM_Q16_ONE;                            \
+        data[i] = ccsgeom_q16Scale(CCS_GEOM_SIGNAL_Q(layout, maxAdc, v, d, ndark), r, g);                     \
+    }                                                                                                         \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_q16EvenOdd(const ViUInt16 raw[], const ViUInt32 gain[], const int64_t dark[],       \
+                                     const int64_t recip[], int64_t ndark, ViInt32 data[])                    \
+{                                                                                                             \
+    const int s0 = CCS_GEOM_SLOT0(layout, darkOff, scanOff, numPix), s1 = s0 ^ 1;                             \
+    ViUInt16 a, b;                                                                                            \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i += 2) {                                                                       \
+        a = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        b = raw[CCS_GEOM_POS(layout, scanOff, numPix, i + 1)];                                                \
+        data[i]     = ccsgeom_q16Scale(CCS_GEOM_SIGNAL_Q(layout, maxAdc, a, dark[s0], ndark),                 \
+                                       recip[s0], gain[i]);                                                   \
+        data[i + 1] = ccsgeom_q16Scale(CCS_GEOM_SIGNAL_Q(layout, maxAdc, b, dark[s1], ndark),                 \
+                                       recip[s1], gain[i + 1]);                                               \
+    }                                                                                                         \
+}                                                                                                             \
+                                                                                                              \
+static inline void name##_q16Clamped(const ViUInt16 raw[], const ViUInt32 gain[], const int64_t dark[],       \
+                                     const int64_t recip[], int64_t ndark, ViInt32 data[])                    \
+{                                                                                                             \
+    const int s0 = CCS_GEOM_SLOT0(layout, darkOff, scanOff, numPix), s1 = s0 ^ 1;                             \
+    ViInt32 v0, v1;                                                                                           \
+    ViUInt16 a, b;                                                                                            \
+    int i;                                                                                                    \
+                                                                                                              \
+    for (i = 0; i < (numPix); i += 2) {                                                                       \
+        a = raw[CCS_GEOM_POS(layout, scanOff, numPix, i)];                                                    \
+        b = raw[CCS_GEOM_POS(layout, scanOff, numPix, i + 1)];                                                \
+        v0 = ccsgeom_q16Scale(CCS_GEOM_SIGNAL_Q(layout, maxAdc, a, dark[s0], ndark),                          \
+                              recip[s0], gain[i]);                                                            \
+        v1 = ccsgeom_q16Scale(CCS_GEOM_SIGNAL_Q(layout, maxAdc, b, dark[s1], ndark),                          \
+                              recip[s1], gain[i + 1]);                                                        \
+        data[i]     = (v0 > 0) ? v0 : 0;                                                                      \
+        data[i + 1] = (v1 > 0) ? v1 : 0;                                                                      \
+    }                                                                                                         \
+}
+
+#endif
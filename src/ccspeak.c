@@ -0,0 +1,191 @@
+/* Peak detection on processed spectra */
+
+#include <stdint.h>
+#include <math.h>
+#include "vitypes.h"
+#include "ccspeak.h"
+
+#define PEAK_DEF_HALFWIDTH  2
+
+
+// wavelength at a fractional pixel position
+static ViReal64 wl_at(const ViReal64 wl[], ViUInt32 npix, ViReal64 pos) {
+    ViUInt32 i = (ViUInt32)pos;
+
+    if (i >= npix - 1) {
+        return wl[npix - 1];
+    }
+    return wl[i] + (pos - i) * (wl[i + 1] - wl[i]);
+}
+
+
+// height above the higher of the minima between the peak and the next higher point on either side
+static ViReal64 prominence(const ViReal64 data[], ViUInt32 npix, ViUInt32 i) {
+    ViReal64 h = data[i], lmin = h, rmin = h;
+    ViUInt32 j;
+
+    for (j = i; j-- > 0 && data[j] <= h; ) {
+        if (data[j] < lmin) lmin = data[j];
+    }
+    for (j = i + 1; j < npix && data[j] <= h; j++) {
+        if (data[j] < rmin) rmin = data[j];
+    }
+    return h - ((lmin > rmin) ? lmin : rmin);
+}
+
+
+// fractional pixels where the peak falls below level on either side
+static void crossings(const ViReal64 data[], ViUInt32 npix, ViUInt32 i, ViReal64 level, ViReal64 *left, ViReal64 *right) {
+    ViUInt32 j;
+
+    for (j = i; j > 0 && data[j - 1] > level; j--)
+        ;
+    *left = (j > 0) ? (j - 1) + (level - data[j - 1]) / (data[j] - data[j - 1]) : 0.0;
+
+    for (j = i; j < npix - 1 && data[j + 1] > level; j++)
+        ;
+    *right = (j < npix - 1) ? j + (data[j] - level) / (data[j] - data[j + 1]) : (ViReal64)(npix - 1);
+}
+
+
+static void locate(const ccs_peak_cfg_t *cfg, const ViReal64 data[], ViUInt32 npix, ViUInt32 i, ViReal64 prom, ccs_peak_t *pk) {
+    ViReal64 a = data[i - 1], b = data[i], c = data[i + 1];
+    ViReal64 den, d, base, w, sw, sxw;
+    ViUInt32 hw, lo, hi, j;
+
+    pk->position = i;
+    pk->height = b;
+
+    switch (cfg->method) {
+    case CCS_PEAK_GAUSSIAN:
+        if ((a > 0.0) && (b > 0.0) && (c > 0.0)) {
+            a = log(a);
+            b = log(b);
+            c = log(c);
+            den = a - 2.0 * b + c;
+            if (den < 0.0) {
+                d = 0.5 * (a - c) / den;
+                pk->position = i + d;
+                pk->height = exp(b - 0.25 * (a - c) * d);
+            }
+            break;
+        }
+        // log of non-positive data: fall back to the parabola
+    case CCS_PEAK_PARABOLIC:
+        den = a - 2.0 * b + c;
+        if (den < 0.0) {
+            d = 0.5 * (a - c) / den;
+            pk->position = i + d;
+            pk->height = b - 0.25 * (a - c) * d;
+        }
+        break;
+
+    default:
+        hw = cfg->halfWidth ? cfg->halfWidth : PEAK_DEF_HALFWIDTH;
+        lo = (i > hw) ? i - hw : 0;
+        hi = (i + hw < npix - 1) ? i + hw : npix - 1;
+        base = b - prom;
+        sw = sxw = 0.0;
+        for (j = lo; j <= hi; j++) {
+            w = data[j] - base;
+            w = (w > 0.0) ? w : 0.0;
+            sw += w;
+            sxw += w * j;
+        }
+        if (sw > 0.0) {
+            pk->position = sxw / sw;
+        }
+        break;
+    }
+}
+
+
+static void sort_by_pixel(ccs_peak_t peaks[], ViUInt32 n) {
+    ViUInt32 i, j;
+    ccs_peak_t t;
+
+    for (i = 1; i < n; i++) {
+        t = peaks[i];
+        for (j = i; j > 0 && peaks[j - 1].pixel > t.pixel; j--) {
+            peaks[j] = peaks[j - 1];
+        }
+        peaks[j] = t;
+    }
+}
+
+
+ViUInt32 CCSpeak_find(const ccs_peak_cfg_t *cfg, const ViReal64 data[], const ViReal64 wl[], ViUInt32 npix,
+                      ccs_peak_t peaks[], ViUInt32 maxPeaks) {
+    const ViReal64 thr = cfg->threshold;
+    ViUInt32 n = 0, start, end, i, j, k, weakest;
+    ViReal64 prom, left, right;
+    uint64_t mask;
+    ccs_peak_t pk;
+    int reordered = 0;
+
+    if (!data || !peaks || !maxPeaks || (npix < 3)) {
+        return 0;
+    }
+
+    for (start = 1; start < npix - 1; start += 64) {
+        end = (start + 64 < npix - 1) ? start + 64 : npix - 1;
+
+        // candidate maxima of 64 pixels as a bit mask, without branches;
+        // a plateau counts once, at its left end
+        mask = 0;
+        for (i = start; i < end; i++) {
+            mask |= (uint64_t)((data[i] > data[i - 1]) & (data[i] >= data[i + 1]) & (data[i] >= thr)) << (i - start);
+        }
+
+        while (mask) {
+            i = start + __builtin_ctzll(mask);
+            mask &= mask - 1;
+
+            // a plateau is a peak only if it falls off at its right end, not for 1,2,2,3
+            if (data[i + 1] == data[i]) {
+                for (j = i + 1; (j < npix - 1) && (data[j + 1] == data[i]); j++)
+                    ;
+                if ((j == npix - 1) || (data[j + 1] > data[i])) {
+                    continue;
+                }
+            }
+
+            // a flat top has no half prominence level to measure the width at
+            prom = prominence(data, npix, i);
+            if ((prom <= 0.0) || (prom < cfg->prominence)) {
+                continue;
+            }
+
+            pk.pixel = i;
+            pk.prominence = prom;
+            locate(cfg, data, npix, i, prom, &pk);
+            crossings(data, npix, i, data[i] - 0.5 * prom, &left, &right);
+            if (wl) {
+                pk.wavelength = wl_at(wl, npix, pk.position);
+                pk.fwhm = fabs(wl_at(wl, npix, right) - wl_at(wl, npix, left));
+            } else {
+                pk.wavelength = 0.0;
+                pk.fwhm = right - left;
+            }
+
+            if (n < maxPeaks) {
+                peaks[n++] = pk;
+                continue;
+            }
+            // full: replace the least prominent if this one beats it
+            weakest = 0;
+            for (k = 1; k < n; k++) {
+                if (peaks[k].prominence < peaks[weakest].prominence) weakest = k;
+            }
+            if (prom > peaks[weakest].prominence) {
+                peaks[weakest] = pk;
+                reordered = 1;
+            }
+        }
+    }
+
+    if (reordered) {
+        sort_by_pixel(peaks, n);
+    }
+    return n;
+}
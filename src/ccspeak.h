@@ -0,0 +1,48 @@
+/* Peak detection on processed spectra.
+ *
+ * Finds local maxima above a height threshold and with a minimum
+ * prominence, locates them to a fraction of a pixel and measures their full
+ * width at half prominence. Works on the output of CCSseries_getScanData
+ * and, if given, maps positions and widths onto the wavelength axis.
+ * Nothing is allocated per call; the caller provides the result array. */
+#ifndef __ccspeak_h__
+#define __ccspeak_h__
+
+#include "vitypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// sub-pixel position methods
+#define CCS_PEAK_CENTROID       0   // intensity centroid over the pixels above the peak's base
+#define CCS_PEAK_PARABOLIC      1   // vertex of the parabola through the maximum and its neighbours
+#define CCS_PEAK_GAUSSIAN       2   // same on the logarithm, exact for Gaussian lines
+
+typedef struct {
+    ViReal64    threshold;      // minimum peak height
+    ViReal64    prominence;     // minimum height above the higher of the two surrounding minima
+    ViInt32     method;         // CCS_PEAK_*
+    ViUInt32    halfWidth;      // centroid window on each side of the maximum, 0 = 2 pixels
+} ccs_peak_cfg_t;
+
+typedef struct {
+    ViUInt32    pixel;          // pixel of the maximum
+    ViReal64    position;       // sub-pixel position in pixels
+    ViReal64    wavelength;     // at position, 0 without a wavelength array
+    ViReal64    height;         // peak value, from the fit for the parabolic and Gaussian methods
+    ViReal64    prominence;
+    ViReal64    fwhm;           // width at half prominence, in nm with a wavelength array, else pixels
+} ccs_peak_t;
+
+/* Finds the peaks in data[npix] and returns how many were stored in peaks.
+ * wl may be VI_NULL. If more than maxPeaks qualify, the most prominent are
+ * kept. Peaks are returned in pixel order. */
+ViUInt32 CCSpeak_find(const ccs_peak_cfg_t *cfg, const ViReal64 data[], const ViReal64 wl[], ViUInt32 npix,
+                      ccs_peak_t peaks[], ViUInt32 maxPeaks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+/* Shared-memory ring buffer for publishing spectra to local consumers */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "vitypes.h"
+#include "ccsshm.h"
+
+#define SHM_ALIGN   64      // keep slots on their own cache lines
+
+struct ccs_shm {
+    ccs_shm_hdr_t   *hdr;
+    uint8_t         *slots;
+    size_t          size;
+    char            *name;  // set for the publisher, which removes the object on close
+};
+
+
+static size_t align_up(size_t n) {
+    return (n + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+static size_t sample_size(uint32_t kind) {
+    return (kind == CCS_SHM_KIND_RAW) ? sizeof(uint16_t) : sizeof(double);
+}
+
+static size_t slots_offset(uint32_t npix) {
+    return align_up(sizeof(ccs_shm_hdr_t) + npix * sizeof(double));
+}
+
+static ccs_shm_slot_t *slot_at(ccs_shm_t *shm, uint64_t index) {
+    return (ccs_shm_slot_t *)(shm->slots + (index % shm->hdr->nslots) * shm->hdr->slotsize);
+}
+
+
+ViStatus CCSshm_create(const char *name, ViUInt32 kind, ViUInt32 npix, ViUInt32 nslots, const ViReal64 wavelength[], ccs_shm_t **shm) {
+    ccs_shm_t *s;
+    size_t slotsize;
+    int fd;
+
+    if (!name || !shm || !npix || (kind > CCS_SHM_KIND_RAW)) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    *shm = NULL;
+    if (!nslots) {
+        nslots = CCS_SHM_DEF_SLOTS;
+    }
+
+    if (!(s = calloc(1, sizeof(ccs_shm_t))) || !(s->name = strdup(name))) {
+        free(s);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    slotsize = align_up(sizeof(ccs_shm_slot_t) + npix * sample_size(kind));
+    s->size = slots_offset(npix) + nslots * slotsize;
+
+    // start from a fresh object so readers of an old run never see a half-built header
+    shm_unlink(name);
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        free(s->name);
+        free(s);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    if (ftruncate(fd, s->size) ||
+        (s->hdr = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        shm_unlink(name);
+        free(s->name);
+        free(s);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    close(fd);
+
+    s->slots = (uint8_t *)s->hdr + slots_offset(npix);
+    s->hdr->version = CCS_SHM_VERSION;
+    s->hdr->kind = kind;
+    s->hdr->npix = npix;
+    s->hdr->nslots = nslots;
+    s->hdr->slotsize = slotsize;
+    s->hdr->head = 0;
+    if (wavelength) {
+        memcpy(s->hdr->wavelength, wavelength, npix * sizeof(double));
+    }
+    // the magic goes in last; readers refuse the object until it is there
+    __atomic_store_n(&s->hdr->magic, CCS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    *shm = s;
+    return VI_SUCCESS;
+}
+
+
+ViStatus CCSshm_publish(ccs_shm_t *shm, ViUInt32 seq, ViUInt32 navg, const struct timespec *stamp, const void *data) {
+    ccs_shm_slot_t *slot;
+    uint64_t index;
+    uint32_t lock;
+
+    if (!shm || !shm->name || !data) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    index = shm->hdr->head;
+    slot = slot_at(shm, index);
+
+    lock = slot->lock;
+    __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->navg = navg;
+    slot->index = index;
+    slot->seq = seq;
+    slot->stamp = stamp ? stamp->tv_sec + stamp->tv_nsec * 1e-9 : 0.0;
+    memcpy(slot + 1, data, shm->hdr->npix * sample_size(shm->hdr->kind));
+
+    __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->hdr->head, index + 1, __ATOMIC_RELEASE);
+    return VI_SUCCESS;
+}
+
+
+ViStatus CCSshm_open(const char *name, ccs_shm_t **shm) {
+    ccs_shm_t *s;
+    struct stat st;
+    ccs_shm_hdr_t *hdr;
+    int fd;
+
+    if (!name || !shm) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    *shm = NULL;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(ccs_shm_hdr_t)) ||
+        (hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    close(fd);
+
+    if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != CCS_SHM_MAGIC) ||
+        (hdr->version != CCS_SHM_VERSION) || !hdr->nslots ||
+        (slots_offset(hdr->npix) + (size_t)hdr->nslots * hdr->slotsize > (size_t)st.st_size)) {
+        munmap(hdr, st.st_size);
+        return VI_ERROR_RSRC_NFOUND;
+    }
+
+    if (!(s = calloc(1, sizeof(ccs_shm_t)))) {
+        munmap(hdr, st.st_size);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    s->hdr = hdr;
+    s->slots = (uint8_t *)hdr + slots_offset(hdr->npix);
+    s->size = st.st_size;
+
+    *shm = s;
+    return VI_SUCCESS;
+}
+
+
+const ccs_shm_hdr_t *CCSshm_header(ccs_shm_t *shm) {
+    return shm->hdr;
+}
+
+
+ViStatus CCSshm_latest(ccs_shm_t *shm, uint64_t *index) {
+    uint64_t head = __atomic_load_n(&shm->hdr->head, __ATOMIC_ACQUIRE);
+
+    if (!head) {
+        return VI_WARN_CCS_SHM_STALE;
+    }
+    *index = head - 1;
+    return VI_SUCCESS;
+}
+
+
+ViStatus CCSshm_peek(ccs_shm_t *shm, uint64_t index, const ccs_shm_slot_t **slot, uint32_t *lock) {
+    uint64_t head = __atomic_load_n(&shm->hdr->head, __ATOMIC_ACQUIRE);
+    const ccs_shm_slot_t *sl;
+    uint32_t l;
+
+    if ((index >= head) || (head - index > shm->hdr->nslots)) {
+        return VI_WARN_CCS_SHM_STALE;
+    }
+    sl = slot_at(shm, index);
+    l = __atomic_load_n(&sl->lock, __ATOMIC_ACQUIRE);
+    if ((l & 1) || (sl->index != index)) {
+        return VI_WARN_CCS_SHM_STALE;
+    }
+    *slot = sl;
+    *lock = l;
+    return VI_SUCCESS;
+}
+
+
+ViStatus CCSshm_validate(ccs_shm_t *shm, const ccs_shm_slot_t *slot, uint32_t lock) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == lock) ? VI_SUCCESS : VI_WARN_CCS_SHM_STALE;
+}
+
+
+void CCSshm_close(ccs_shm_t *shm) {
+    if (!shm) {
+        return;
+    }
+    munmap(shm->hdr, shm->size);
+    if (shm->name) {
+        shm_unlink(shm->name);
+        free(shm->name);
+    }
+    free(shm);
+}
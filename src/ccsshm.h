@@ -0,0 +1,87 @@
+/* Shared-memory ring buffer for publishing spectra to local consumers.
+ *
+ * One publisher writes frames into a POSIX shared-memory object that holds
+ * a fixed number of slots. Each slot carries a seqlock counter that is odd
+ * while the publisher is writing it, so any number of readers can use the
+ * newest frames in place, without copying and without locking the writer
+ * out. A reader that was overtaken by the writer notices it in
+ * CCSshm_validate and simply drops or retries that frame. */
+#ifndef __ccsshm_h__
+#define __ccsshm_h__
+
+#include <stdint.h>
+#include <time.h>
+#include "vitypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CCS_SHM_MAGIC           0x43435352u     // "CCSR"
+#define CCS_SHM_VERSION         1
+#define CCS_SHM_DEF_SLOTS       8
+
+// slot payload
+#define CCS_SHM_KIND_PROCESSED  0               // npix ViReal64, as from CCSseries_getScanData
+#define CCS_SHM_KIND_RAW        1               // npix ViUInt16, as from CCSseries_getRawScanData
+
+// the frame asked for is no longer (or not yet) in the ring
+#define VI_WARN_CCS_SHM_STALE   (0x3FFC0A02L)
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    kind;
+    uint32_t    npix;
+    uint32_t    nslots;
+    uint32_t    slotsize;           // bytes from one slot header to the next
+    uint64_t    head;               // number of frames published so far
+    double      wavelength[];       // npix entries, followed by the slots
+} ccs_shm_hdr_t;
+
+typedef struct {
+    uint32_t    lock;               // seqlock counter, odd while being written
+    uint32_t    navg;               // number of scans averaged into data
+    uint64_t    index;              // publish index of the frame in this slot
+    uint64_t    seq;                // frame number as given by the publisher
+    double      stamp;              // CLOCK_MONOTONIC seconds
+} ccs_shm_slot_t;                   // followed by npix samples of the header's kind
+
+#define CCS_SHM_SLOT_DATA(slot)     ((const double *)((slot) + 1))
+#define CCS_SHM_SLOT_RAW(slot)      ((const uint16_t *)((slot) + 1))
+
+typedef struct ccs_shm ccs_shm_t;
+
+/* Creates (or replaces) the object /name with nslots slots, 0 = CCS_SHM_DEF_SLOTS.
+ * wavelength may be VI_NULL; otherwise npix entries are copied into the header. */
+ViStatus CCSshm_create(const char *name, ViUInt32 kind, ViUInt32 npix, ViUInt32 nslots, const ViReal64 wavelength[], ccs_shm_t **shm);
+
+/* Writes one frame into the next slot and makes it the newest. */
+ViStatus CCSshm_publish(ccs_shm_t *shm, ViUInt32 seq, ViUInt32 navg, const struct timespec *stamp, const void *data);
+
+/* Maps an existing object read-only. */
+ViStatus CCSshm_open(const char *name, ccs_shm_t **shm);
+
+/* The header, for npix, kind and the wavelength array. */
+const ccs_shm_hdr_t *CCSshm_header(ccs_shm_t *shm);
+
+/* Publish index of the newest frame; VI_WARN_CCS_SHM_STALE if nothing was published yet. */
+ViStatus CCSshm_latest(ccs_shm_t *shm, uint64_t *index);
+
+/* Points slot at frame index inside the shared memory and returns the lock
+ * value to hand to CCSshm_validate once done with it. Returns
+ * VI_WARN_CCS_SHM_STALE if the frame was overwritten or is not published yet. */
+ViStatus CCSshm_peek(ccs_shm_t *shm, uint64_t index, const ccs_shm_slot_t **slot, uint32_t *lock);
+
+/* VI_SUCCESS if nothing touched the slot since CCSshm_peek, so whatever
+ * was read from it is consistent; VI_WARN_CCS_SHM_STALE otherwise. */
+ViStatus CCSshm_validate(ccs_shm_t *shm, const ccs_shm_slot_t *slot, uint32_t lock);
+
+/* Unmaps; the publisher also removes the object. */
+void CCSshm_close(ccs_shm_t *shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,645 @@
+/* Streaming acquisition for CCS series spectrometers */
+
+#define _GNU_SOURCE     // pthread_attr_setaffinity_np
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <math.h>
+#include "vitypes.h"
+#include "CCS_Series_Drv.h"
+#include "spxdrv.h"
+#include "ccsstream.h"
+
+// running timing statistics
+struct timing_acc {
+    ViUInt32        scans;
+    ViUInt32        periods;
+    ViReal64        mean, m2;       // of the periods, updated as by Welford
+    ViReal64        pmin, pmax;
+    ViReal64        latSum, latMax;
+    struct timespec last;           // arrival of the previous scan
+    int             haveLast;
+};
+
+struct ccs_stream {
+    ViSession       instr;
+    const ccs_stream_ops_t *ops;
+    ccs_stream_cfg_t cfg;
+
+    pthread_t       worker;
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;          // signalled when a frame was queued or the worker ended
+    pthread_cond_t  applied;        // signalled when the worker took a setting request
+    int             efd;            // eventfd, readable while frames are queued or the worker ended
+
+    ccs_frame_t     *frames;        // cfg.depth preallocated frames
+    ccs_frame_t     **freelist;     // frames the worker may fill
+    ViUInt32        nfree;
+    ccs_frame_t     **queue;        // filled frames, oldest at qhead
+    ViUInt32        qhead;
+    ViUInt32        qlen;
+
+    int             stop;           // set by CCSstream_stop
+    int             done;           // worker has finished
+    ViStatus        err;            // why the worker finished
+
+    int             setreq;         // new integration time waiting for the worker
+    int             setAsync;       // setreq came from CCSstream_requestIntegrationTime
+    int             setDone;        // its outcome is in setErr and was not collected yet
+    ViReal64        setInt;
+    ViStatus        setErr;
+
+    ViUInt32        produced;
+    ViUInt32        overruns;
+    struct timing_acc tm;           // kept by the worker without the lock
+    struct timing_acc tmPub;        // copy of tm, updated under the lock once per frame
+
+    ViReal64        scan[CCS_SERIES_NUM_PIXELS];    // scratch for averaging and dropped frames
+};
+
+
+#define SPX_OPEN_TIMEOUT    2000    // ms, within SPX_TIMEOUT_MIN ... SPX_TIMEOUT_MAX
+
+
+static ViStatus ccs_open(ViRsrc rsrc, ViPSession instr) {
+    return CCSseries_init(rsrc, VI_ON, VI_ON, instr);
+}
+
+
+static ViStatus ccs_wavelengths(ViSession instr, ViReal64 data[]) {
+    return CCSseries_getWavelengthData(instr, CCS_SERIES_CAL_DATA_SET_FACTORY, data, VI_NULL, VI_NULL);
+}
+
+
+// any command other than get scan data / get status ends continuous scanning
+static ViStatus ccs_stop(ViSession instr) {
+    ViReal64 t;
+
+    return CCSseries_getIntegrationTime(instr, &t);
+}
+
+
+// the SPx driver reports a scan that is not there yet as a warning
+static ViStatus spx_scan(ViSession instr, ViReal64 data[]) {
+    ViStatus err = SPX_getScanData(instr, data);
+
+    return (err == VI_WARN_SPX_DATA_NOT_READY) ? VI_ERROR_TMO : err;
+}
+
+
+// SPX_init resets the device itself
+static ViStatus spx_open(ViRsrc rsrc, ViPSession instr) {
+    return SPX_init(rsrc, SPX_OPEN_TIMEOUT, instr);
+}
+
+
+static ViStatus spx_wavelengths(ViSession instr, ViReal64 data[]) {
+    return SPX_getWavelengthData(instr, data, VI_NULL, VI_NULL);
+}
+
+
+// a reset rewrites the integration time, which ends continuous scanning, and flushes the pipe
+static ViStatus spx_stop(ViSession instr) {
+    return SPX_reset(instr);
+}
+
+
+const ccs_stream_ops_t CCSstream_opsCCS = {
+    CCS_SERIES_NUM_PIXELS,
+    ccs_open,
+    CCSseries_close,
+    ccs_wavelengths,
+    CCSseries_errorMessage,
+    CCSseries_getScanData,
+    CCSseries_setIntegrationTime,
+    CCSseries_getIntegrationTime,
+    CCSseries_startScanCont,
+    ccs_stop
+};
+
+const ccs_stream_ops_t CCSstream_opsSPX = {
+    SPX_NUM_PIXELS,
+    spx_open,
+    SPX_close,
+    spx_wavelengths,
+    SPX_errorMessage,
+    spx_scan,
+    SPX_setIntTime,
+    SPX_getIntTime,
+    SPX_startScanCont,
+    spx_stop
+};
+
+
+const ccs_stream_ops_t *CCSstream_opsFor(ViRsrc rsrc) {
+    unsigned short vid = 0, pid = 0;
+
+    sscanf(rsrc, "%hx:%hx", &vid, &pid);
+    if ((vid == SPX_VID) && ((pid == SP1_USB_PID) || (pid == SP2_USB_PID))) {
+        return &CCSstream_opsSPX;
+    }
+    return &CCSstream_opsCCS;
+}
+
+
+static double elapsed(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) * 1e-9;
+}
+
+
+// read one scan, retrying timeouts as long as nobody asked us to stop
+static ViStatus read_scan(ccs_stream_t *s, ViReal64 data[]) {
+    ViStatus err;
+
+    for (;;) {
+        err = s->ops->getScanData(s->instr, data);
+        if (err != VI_ERROR_TMO) {
+            return err;
+        }
+        // long integration times run past the usb timeout; just wait again
+        pthread_mutex_lock(&s->lock);
+        if (s->stop) {
+            pthread_mutex_unlock(&s->lock);
+            return err;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+
+// read_scan, recording when the read was issued and when the scan arrived
+static ViStatus timed_scan(ccs_stream_t *s, ViReal64 data[]) {
+    struct timing_acc *tm = &s->tm;
+    struct timespec issued, arrived;
+    ViReal64 lat, p, d;
+    ViStatus err;
+
+    clock_gettime(CLOCK_MONOTONIC, &issued);
+    if ((err = read_scan(s, data))) {
+        return err;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &arrived);
+
+    if (tm->haveLast) {
+        lat = elapsed(&tm->last, &issued);
+        tm->latSum += lat;
+        if (lat > tm->latMax) tm->latMax = lat;
+
+        p = elapsed(&tm->last, &arrived);
+        if (!tm->periods || (p < tm->pmin)) tm->pmin = p;
+        if (p > tm->pmax) tm->pmax = p;
+        tm->periods++;
+        d = p - tm->mean;
+        tm->mean += d / tm->periods;
+        tm->m2 += d * (p - tm->mean);
+    }
+    tm->last = arrived;
+    tm->haveLast = 1;
+    tm->scans++;
+    return VI_SUCCESS;
+}
+
+
+static void notify(ccs_stream_t *s) {
+    uint64_t one = 1;
+
+    if (write(s->efd, &one, sizeof(one)) < 0) {
+        // counter is saturated, the fd is readable anyway
+    }
+}
+
+
+// change the integration time between frames; the set command ends
+// continuous scanning, so it has to be restarted afterwards
+static ViStatus apply_settings(ccs_stream_t *s) {
+    ViStatus err, restart;
+
+    err = s->ops->setIntegrationTime(s->instr, s->setInt);
+    restart = s->ops->startScanCont(s->instr);
+
+    pthread_mutex_lock(&s->lock);
+    if (!err) {
+        s->cfg.intTime = s->setInt;
+    }
+    s->setreq = 0;
+    s->setErr = err ? err : restart;
+    s->tm.haveLast = 0;
+    if (s->setAsync) {
+        s->setAsync = 0;
+        s->setDone = 1;
+        notify(s);
+    }
+    pthread_cond_broadcast(&s->applied);
+    pthread_mutex_unlock(&s->lock);
+    return restart;
+}
+
+
+static void *stream_worker(void *arg) {
+    ccs_stream_t *s = arg;
+    ccs_frame_t *f;
+    struct timespec t0;
+    ViReal64 *acc;
+    ViStatus err = VI_SUCCESS;
+    ViUInt32 seq = 0;
+    ViUInt32 navg, n;
+    ViUInt32 npix = s->ops->npix;
+    ViUInt32 i;
+
+    navg = (s->cfg.average > 1) ? s->cfg.average : 1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        if (s->stop) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        if (s->setreq) {
+            pthread_mutex_unlock(&s->lock);
+            if ((err = apply_settings(s))) {
+                break;
+            }
+            pthread_mutex_lock(&s->lock);
+        }
+        // grab a free frame; when the consumer holds all of them this one is dropped
+        f = s->nfree ? s->freelist[--s->nfree] : NULL;
+        pthread_mutex_unlock(&s->lock);
+
+        acc = f ? f->data : s->scan;
+        if ((err = timed_scan(s, acc))) {
+            break;
+        }
+        for (n = 1; n < navg; n++) {
+            if ((err = timed_scan(s, s->scan))) {
+                break;
+            }
+            if (f) {
+                for (i = 0; i < npix; i++) {
+                    acc[i] += s->scan[i];
+                }
+            }
+        }
+        if (err) {
+            break;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if (f) {
+            if (navg > 1) {
+                for (i = 0; i < npix; i++) {
+                    acc[i] /= (ViReal64)navg;
+                }
+            }
+            f->seq = seq;
+            f->navg = navg;
+            f->npix = npix;
+            f->stamp = s->tm.last;
+            s->queue[(s->qhead + s->qlen) % s->cfg.depth] = f;
+            s->produced++;
+            // consumers only wait on an empty queue, spare the wakeup otherwise
+            if (!s->qlen++) {
+                pthread_cond_broadcast(&s->ready);
+                notify(s);
+            }
+        } else {
+            s->overruns++;
+        }
+        s->tmPub = s->tm;
+        pthread_mutex_unlock(&s->lock);
+        seq++;
+
+        if (s->cfg.frames && seq >= s->cfg.frames) {
+            break;
+        }
+        if ((s->cfg.duration > 0.0) && (elapsed(&t0, &s->tm.last) >= s->cfg.duration)) {
+            break;
+        }
+    }
+
+    s->ops->stopScanCont(s->instr);
+
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    s->err = s->stop ? VI_SUCCESS : err;
+    s->tmPub = s->tm;
+    pthread_cond_broadcast(&s->ready);
+    pthread_cond_broadcast(&s->applied);
+    notify(s);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+
+// scheduling and CPUs of the worker thread as configured
+static ViStatus worker_attr(const ccs_stream_cfg_t *cfg, pthread_attr_t *attr) {
+    struct sched_param param;
+    cpu_set_t set;
+    ViUInt32 i;
+
+    if (cfg->rtPriority) {
+        if ((cfg->rtPriority < sched_get_priority_min(SCHED_FIFO)) || (cfg->rtPriority > sched_get_priority_max(SCHED_FIFO))) {
+            return VI_ERROR_INV_PARAMETER;
+        }
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = cfg->rtPriority;
+        pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+        pthread_attr_setschedparam(attr, &param);
+    }
+    if (cfg->cpus) {
+        CPU_ZERO(&set);
+        for (i = 0; i < 8 * sizeof(cfg->cpus); i++) {
+            if ((cfg->cpus >> i) & 1) {
+                CPU_SET(i, &set);
+            }
+        }
+        if (pthread_attr_setaffinity_np(attr, sizeof(set), &set)) {
+            return VI_ERROR_INV_PARAMETER;
+        }
+    }
+    return VI_SUCCESS;
+}
+
+
+static void stream_free(ccs_stream_t *s) {
+    if (s->efd >= 0) {
+        close(s->efd);
+    }
+    pthread_cond_destroy(&s->applied);
+    pthread_cond_destroy(&s->ready);
+    pthread_mutex_destroy(&s->lock);
+    free(s->queue);
+    free(s->freelist);
+    free(s->frames);
+    free(s);
+}
+
+
+ViStatus CCSstream_start(ViSession instr, const ccs_stream_cfg_t *cfg, ccs_stream_t **stream) {
+    pthread_attr_t attr;
+    ccs_stream_t *s;
+    ViStatus err;
+    ViUInt32 i;
+    int rc;
+
+    if (!cfg || !stream) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    *stream = NULL;
+
+    if (!(s = calloc(1, sizeof(ccs_stream_t)))) {
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    s->instr = instr;
+    s->cfg = *cfg;
+    s->ops = cfg->ops ? cfg->ops : &CCSstream_opsCCS;
+    if (!s->cfg.depth) {
+        s->cfg.depth = CCS_STREAM_DEF_DEPTH;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->ready, NULL);
+    pthread_cond_init(&s->applied, NULL);
+    s->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    s->frames = malloc(s->cfg.depth * sizeof(ccs_frame_t));
+    s->freelist = malloc(s->cfg.depth * sizeof(ccs_frame_t*));
+    s->queue = malloc(s->cfg.depth * sizeof(ccs_frame_t*));
+    if (!s->frames || !s->freelist || !s->queue || (s->efd < 0)) {
+        stream_free(s);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    for (i = 0; i < s->cfg.depth; i++) {
+        s->freelist[i] = &s->frames[i];
+    }
+    s->nfree = s->cfg.depth;
+
+    // fault the frames in now rather than on the first scans; without
+    // CAP_IPC_LOCK locking fails beyond RLIMIT_MEMLOCK
+    memset(s->frames, 0, s->cfg.depth * sizeof(ccs_frame_t));
+    if (s->cfg.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        stream_free(s);
+        return VI_ERROR_NPERMISSION;
+    }
+
+    pthread_attr_init(&attr);
+    if ((err = worker_attr(&s->cfg, &attr))) {
+        pthread_attr_destroy(&attr);
+        stream_free(s);
+        return err;
+    }
+
+    if (s->cfg.intTime > 0.0) {
+        err = s->ops->setIntegrationTime(instr, s->cfg.intTime);
+    } else {
+        err = s->ops->getIntegrationTime(instr, &s->cfg.intTime);
+    }
+    if (err) {
+        pthread_attr_destroy(&attr);
+        stream_free(s);
+        return err;
+    }
+    if ((err = s->ops->startScanCont(instr))) {
+        pthread_attr_destroy(&attr);
+        stream_free(s);
+        return err;
+    }
+    rc = pthread_create(&s->worker, &attr, stream_worker, s);
+    pthread_attr_destroy(&attr);
+    if (rc) {
+        s->ops->stopScanCont(instr);
+        stream_free(s);
+        return (rc == EPERM) ? VI_ERROR_NPERMISSION : (rc == EINVAL) ? VI_ERROR_INV_PARAMETER : VI_ERROR_SYSTEM_ERROR;
+    }
+
+    *stream = s;
+    return VI_SUCCESS;
+}
+
+
+ViStatus CCSstream_next(ccs_stream_t *s, ccs_frame_t **frame, int timeout) {
+    struct timespec until;
+    ViStatus err = VI_SUCCESS;
+    int rc = 0;
+
+    *frame = NULL;
+    if (timeout > 0) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += timeout / 1000;
+        until.tv_nsec += (timeout % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->qlen && !s->done && (rc != ETIMEDOUT)) {
+        if (timeout < 0) {
+            pthread_cond_wait(&s->ready, &s->lock);
+        } else if (timeout == 0) {
+            rc = ETIMEDOUT;
+        } else {
+            rc = pthread_cond_timedwait(&s->ready, &s->lock, &until);
+        }
+    }
+    if (s->qlen) {
+        *frame = s->queue[s->qhead];
+        s->qhead = (s->qhead + 1) % s->cfg.depth;
+        s->qlen--;
+    } else if (s->done) {
+        err = s->err ? s->err : VI_WARN_CCS_STREAM_END;
+    } else {
+        err = VI_ERROR_TMO;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return err;
+}
+
+
+int CCSstream_fd(ccs_stream_t *s) {
+    return s->efd;
+}
+
+
+void CCSstream_clearFd(ccs_stream_t *s) {
+    uint64_t cnt;
+
+    if (read(s->efd, &cnt, sizeof(cnt)) < 0) {
+        // nothing pending
+    }
+}
+
+
+ViStatus CCSstream_setIntegrationTime(ccs_stream_t *s, ViReal64 intTime) {
+    ViStatus err;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->done) {
+        err = s->err ? s->err : VI_WARN_CCS_STREAM_END;
+        pthread_mutex_unlock(&s->lock);
+        return err;
+    }
+    // one request at a time; a second caller waits for the first to be applied
+    while (s->setreq && !s->done) {
+        pthread_cond_wait(&s->applied, &s->lock);
+    }
+    s->setreq = 1;
+    s->setAsync = 0;
+    s->setInt = intTime;
+    while (s->setreq && !s->done) {
+        pthread_cond_wait(&s->applied, &s->lock);
+    }
+    err = s->setreq ? (s->err ? s->err : VI_WARN_CCS_STREAM_END) : s->setErr;
+    pthread_mutex_unlock(&s->lock);
+    return err;
+}
+
+
+ViStatus CCSstream_requestIntegrationTime(ccs_stream_t *s, ViReal64 intTime) {
+    ViStatus err = VI_SUCCESS;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->done) {
+        err = s->err ? s->err : VI_WARN_CCS_STREAM_END;
+    } else if (s->setreq) {
+        err = VI_ERROR_RSRC_BUSY;
+    } else {
+        s->setreq = 1;
+        s->setAsync = 1;
+        s->setDone = 0;
+        s->setInt = intTime;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return err;
+}
+
+
+ViStatus CCSstream_integrationTimeApplied(ccs_stream_t *s) {
+    ViStatus err = VI_SUCCESS;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->setDone) {
+        s->setDone = 0;
+        err = s->setErr;
+    } else if (s->setreq && s->setAsync) {
+        // the worker never takes it once it has finished
+        err = s->done ? (s->err ? s->err : VI_WARN_CCS_STREAM_END) : VI_ERROR_TMO;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return err;
+}
+
+
+ViReal64 CCSstream_getIntegrationTime(ccs_stream_t *s) {
+    ViReal64 t;
+
+    pthread_mutex_lock(&s->lock);
+    t = s->cfg.intTime;
+    pthread_mutex_unlock(&s->lock);
+    return t;
+}
+
+
+void CCSstream_release(ccs_stream_t *s, ccs_frame_t *frame) {
+    if (!frame) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->freelist[s->nfree++] = frame;
+    pthread_mutex_unlock(&s->lock);
+}
+
+
+void CCSstream_stats(ccs_stream_t *s, ViUInt32 *produced, ViUInt32 *overruns) {
+    pthread_mutex_lock(&s->lock);
+    if (produced) *produced = s->produced;
+    if (overruns) *overruns = s->overruns;
+    pthread_mutex_unlock(&s->lock);
+}
+
+
+void CCSstream_timing(ccs_stream_t *s, ccs_stream_timing_t *timing) {
+    struct timing_acc tm;
+
+    pthread_mutex_lock(&s->lock);
+    tm = s->tmPub;
+    pthread_mutex_unlock(&s->lock);
+
+    memset(timing, 0, sizeof(*timing));
+    timing->scans = tm.scans;
+    if (tm.periods) {
+        timing->periodMean = tm.mean;
+        timing->periodMin = tm.pmin;
+        timing->periodMax = tm.pmax;
+        timing->jitter = sqrt(tm.m2 / tm.periods);
+        timing->latencyMean = tm.latSum / tm.periods;
+        timing->latencyMax = tm.latMax;
+    }
+}
+
+
+ViStatus CCSstream_stop(ccs_stream_t *s) {
+    ViStatus err;
+
+    if (!s) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->worker, NULL);
+
+    err = s->err;
+    stream_free(s);
+    return err;
+}
@@ -0,0 +1,133 @@
+/* Streaming acquisition for CCS series spectrometers.
+ *
+ * A worker thread keeps the spectrometer in continuous scan mode and hands
+ * processed frames to the consumer through a ring of preallocated frames,
+ * so USB reads and whatever the consumer does with the data (writing to
+ * disk, a pipe, shared memory) run concurrently.
+ *
+ * The device family is reached through a table of driver functions, so the
+ * older SP1-USB/SP2-USB spectrometers (spxdrv) stream the same way.
+ *
+ * For hosts busy with other work the worker can run under SCHED_FIFO on
+ * chosen CPUs with the process memory locked. Its loop then makes no system
+ * calls besides the USB reads, apart from waking a consumer waiting on an
+ * empty queue. CCSstream_timing tells how well it keeps up. */
+#ifndef __ccsstream_h__
+#define __ccsstream_h__
+
+#include <time.h>
+#include "vitypes.h"
+#include "CCS_Series_Drv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CCS_STREAM_DEF_DEPTH        16      // frames buffered between worker and consumer
+
+// returned by CCSstream_next once the worker has finished and every frame was handed out
+#define VI_WARN_CCS_STREAM_END      (0x3FFC0A01L)
+
+// driver functions of a device family
+typedef struct {
+    ViUInt32    npix;       // pixels per scan
+    ViStatus    (*open)(ViRsrc rsrc, ViPSession instr);             // identifies and resets the device
+    ViStatus    (*close)(ViSession instr);
+    ViStatus    (*getWavelengthData)(ViSession instr, ViReal64 data[]);    // factory calibration, npix elements
+    ViStatus    (*errorMessage)(ViSession instr, ViStatus err, ViChar msg[]);   // msg holds 512 bytes
+    ViStatus    (*getScanData)(ViSession instr, ViReal64 data[]);  // VI_ERROR_TMO while no scan is ready
+    ViStatus    (*setIntegrationTime)(ViSession instr, ViReal64 intTime);
+    ViStatus    (*getIntegrationTime)(ViSession instr, ViPReal64 intTime);
+    ViStatus    (*startScanCont)(ViSession instr);
+    ViStatus    (*stopScanCont)(ViSession instr);
+} ccs_stream_ops_t;
+
+extern const ccs_stream_ops_t CCSstream_opsCCS;    // CCS series (CCS_Series_Drv)
+extern const ccs_stream_ops_t CCSstream_opsSPX;    // SP1-USB/SP2-USB (spxdrv), session from SPX_init;
+                                                    // SPX_ACQ_MODE_FAST gives the higher frame rate
+
+/* The family of the device a vid:pid resource name refers to,
+ * CCSstream_opsCCS for anything that is not an SPx. */
+const ccs_stream_ops_t *CCSstream_opsFor(ViRsrc rsrc);
+
+typedef struct {
+    const ccs_stream_ops_t *ops;    // device family, VI_NULL = CCSstream_opsCCS
+    ViReal64    intTime;    // integration time in s, 0 keeps the current device setting
+    ViUInt32    frames;     // stop after this many output frames, 0 = no limit
+    ViReal64    duration;   // stop after this many seconds, 0 = no limit
+    ViUInt32    average;    // scans averaged into one output frame, 0 and 1 mean none
+    ViUInt32    depth;      // number of buffered frames, 0 = CCS_STREAM_DEF_DEPTH
+    ViInt32     rtPriority; // SCHED_FIFO priority of the worker, 0 = normal scheduling
+    ViUInt32    cpus;       // CPUs the worker may run on, bit i for CPU i, 0 = any
+    ViBoolean   lockMemory; // mlockall the process, for good, before starting the worker
+} ccs_stream_cfg_t;
+
+typedef struct {
+    ViUInt32        seq;                            // output frame number, counting from 0
+    ViUInt32        navg;                           // number of scans averaged into data
+    ViUInt32        npix;                           // valid elements of data
+    struct timespec stamp;                          // CLOCK_MONOTONIC when the last scan arrived
+    ViReal64        data[CCS_SERIES_NUM_PIXELS];    // processed scan data, large enough for every family
+} ccs_frame_t;
+
+// timing of the scans as the worker read them, in seconds
+typedef struct {
+    ViUInt32    scans;          // scans read
+    ViReal64    periodMean;     // between the arrivals of consecutive scans
+    ViReal64    periodMin;
+    ViReal64    periodMax;
+    ViReal64    jitter;         // standard deviation of the period
+    ViReal64    latencyMean;    // from a scan arriving to the worker reading the next one
+    ViReal64    latencyMax;
+} ccs_stream_timing_t;
+
+typedef struct ccs_stream ccs_stream_t;
+
+/* Sets the integration time, starts continuous scanning and the worker thread.
+ * VI_ERROR_NPERMISSION if the process may not use rtPriority or lockMemory. */
+ViStatus CCSstream_start(ViSession instr, const ccs_stream_cfg_t *cfg, ccs_stream_t **stream);
+
+/* Waits up to timeout ms (-1 = forever, 0 = poll) for the next frame.
+ * Returns VI_ERROR_TMO if none arrived in time, VI_WARN_CCS_STREAM_END after
+ * the last frame, or the error that stopped the worker.
+ * Every frame obtained must be given back with CCSstream_release. */
+ViStatus CCSstream_next(ccs_stream_t *stream, ccs_frame_t **frame, int timeout);
+
+void CCSstream_release(ccs_stream_t *stream, ccs_frame_t *frame);
+
+/* An eventfd that polls readable once frames are queued, the worker ended or
+ * took a change from CCSstream_requestIntegrationTime.
+ * Call CCSstream_clearFd before draining the queue with CCSstream_next(..., 0). */
+int CCSstream_fd(ccs_stream_t *stream);
+void CCSstream_clearFd(ccs_stream_t *stream);
+
+/* Has the worker change the integration time before its next frame and
+ * waits until it did. Frames already queued keep the old setting. */
+ViStatus CCSstream_setIntegrationTime(ccs_stream_t *stream, ViReal64 intTime);
+ViReal64 CCSstream_getIntegrationTime(ccs_stream_t *stream);
+
+/* The same without waiting, for event loops: the worker takes the change
+ * before its next frame and then makes the stream fd readable.
+ * VI_ERROR_RSRC_BUSY while an earlier change is still pending. */
+ViStatus CCSstream_requestIntegrationTime(ccs_stream_t *stream, ViReal64 intTime);
+
+/* Outcome of the last CCSstream_requestIntegrationTime, reported once;
+ * VI_ERROR_TMO while the worker has not taken it yet. */
+ViStatus CCSstream_integrationTimeApplied(ccs_stream_t *stream);
+
+/* Frames produced so far and frames dropped because the consumer fell behind */
+void CCSstream_stats(ccs_stream_t *stream, ViUInt32 *produced, ViUInt32 *overruns);
+
+/* Scan timing so far. A scan the worker does not read within about one
+ * period is overwritten in the device, so the latency is what to watch.
+ * Restarts after an integration time change do not count as periods. */
+void CCSstream_timing(ccs_stream_t *stream, ccs_stream_timing_t *timing);
+
+/* Stops the worker, takes the device out of continuous mode and frees the stream. */
+ViStatus CCSstream_stop(ccs_stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
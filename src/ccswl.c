@@ -0,0 +1,388 @@
+/* Wavelength axis utilities for CCS series spectrometers */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "vitypes.h"
+#include "ccswl.h"
+
+struct ccs_resampler {
+    ViUInt32    nout;
+    ViUInt32    ntaps;      // pixels contributing to each output point, padded with zero weights
+    uint32_t    *idx;       // nout * ntaps pixel numbers
+    ViReal64    *w;         // nout * ntaps weights
+};
+
+#define WL_MAX_COEF     10      // polynomial coefficients kept for refinement, up to order 9
+#define WL_NEWTON_ITER  3       // the linear guess is within a fraction of a pixel already
+
+struct ccs_wl_index {
+    ViUInt32    npix;
+    ViReal64    *x;         // ascending axis
+    uint32_t    *pix;       // pixel number of x[i]
+    ViReal64    xmin;
+    ViReal64    scale;      // buckets per nm
+    ViUInt32    nbuckets;
+    uint32_t    *bucket;    // last i with x[i] at or below the bucket's lower edge
+    ViUInt32    ncoef;
+    ViReal64    poly[WL_MAX_COEF];
+};
+
+
+// ascending copy of the wavelength axis; pix[] maps back to the pixel number
+static ViStatus sort_axis(const ViReal64 wl[], ViUInt32 npix, ViReal64 *x, uint32_t *pix) {
+    int decreasing = wl[npix - 1] < wl[0];
+    ViUInt32 i, p;
+
+    for (i = 0; i < npix; i++) {
+        p = decreasing ? npix - 1 - i : i;
+        x[i] = wl[p];
+        pix[i] = p;
+        if (i && (x[i] <= x[i - 1])) {
+            return VI_ERROR_INV_PARAMETER;  // not monotonic
+        }
+    }
+    return VI_SUCCESS;
+}
+
+
+static void interp_weights(const ViReal64 *x, const uint32_t *pix, ViUInt32 npix, ViReal64 start, ViReal64 step,
+                           ViInt32 method, ccs_resampler_t *rs) {
+    ViUInt32 o, j = 0, k0, m, q;
+    uint32_t *idx;
+    ViReal64 *w, l, t, num, den;
+
+    for (o = 0; o < rs->nout; o++) {
+        idx = rs->idx + o * rs->ntaps;
+        w = rs->w + o * rs->ntaps;
+        l = start + o * step;
+        if ((l < x[0]) || (l > x[npix - 1])) {
+            continue;   // left at zero weight
+        }
+        while ((j < npix - 2) && (x[j + 1] < l)) {
+            j++;
+        }
+
+        if (method == CCS_WL_LINEAR) {
+            t = (l - x[j]) / (x[j + 1] - x[j]);
+            idx[0] = pix[j];
+            idx[1] = pix[j + 1];
+            w[0] = 1.0 - t;
+            w[1] = t;
+            continue;
+        }
+
+        // cubic: Lagrange basis on the four nodes around l, shifted inwards at the ends
+        k0 = (j < 1) ? 0 : j - 1;
+        if (k0 > npix - 4) {
+            k0 = npix - 4;
+        }
+        for (m = 0; m < 4; m++) {
+            num = den = 1.0;
+            for (q = 0; q < 4; q++) {
+                if (q != m) {
+                    num *= l - x[k0 + q];
+                    den *= x[k0 + m] - x[k0 + q];
+                }
+            }
+            idx[m] = pix[k0 + m];
+            w[m] = num / den;
+        }
+    }
+}
+
+
+// pixel j covers [e[j], e[j+1]], edges halfway between the pixel wavelengths
+static void pixel_edges(const ViReal64 *x, ViUInt32 npix, ViReal64 *e) {
+    ViUInt32 i;
+
+    e[0] = x[0] - 0.5 * (x[1] - x[0]);
+    for (i = 1; i < npix; i++) {
+        e[i] = 0.5 * (x[i - 1] + x[i]);
+    }
+    e[npix] = x[npix - 1] + 0.5 * (x[npix - 1] - x[npix - 2]);
+}
+
+
+// walks the pixels overlapping every output bin; with fill unset it only
+// returns the largest number of pixels in one bin
+static ViUInt32 area_weights(const ViReal64 *e, const uint32_t *pix, ViUInt32 npix, ViReal64 start, ViReal64 step,
+                             ViUInt32 nout, ccs_resampler_t *fill) {
+    ViUInt32 o, j = 0, k, n, most = 1;
+    ViReal64 lo, hi, a, b;
+
+    for (o = 0; o < nout; o++) {
+        lo = start + (o - 0.5) * step;
+        hi = lo + step;
+        while ((j < npix) && (e[j + 1] <= lo)) {
+            j++;
+        }
+        for (k = j, n = 0; (k < npix) && (e[k] < hi); k++, n++) {
+            if (fill) {
+                a = (e[k] > lo) ? e[k] : lo;
+                b = (e[k + 1] < hi) ? e[k + 1] : hi;
+                fill->idx[o * fill->ntaps + n] = pix[k];
+                fill->w[o * fill->ntaps + n] = (b - a) / (e[k + 1] - e[k]);
+            }
+        }
+        if (n > most) {
+            most = n;
+        }
+    }
+    return most;
+}
+
+
+ViStatus CCSwl_resamplerCreate(const ViReal64 wl[], ViUInt32 npix, ViReal64 start, ViReal64 step, ViUInt32 nout, ViInt32 method, ccs_resampler_t **rs) {
+    ccs_resampler_t *r = NULL;
+    ViReal64 *x = NULL, *e = NULL;
+    uint32_t *pix = NULL;
+    ViStatus err = VI_ERROR_SYSTEM_ERROR;
+
+    if (!wl || !rs || (npix < 4) || !nout || !(step > 0.0) || (method < CCS_WL_LINEAR) || (method > CCS_WL_AREA)) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    *rs = NULL;
+
+    x = malloc(npix * sizeof(ViReal64));
+    e = malloc((npix + 1) * sizeof(ViReal64));
+    pix = malloc(npix * sizeof(uint32_t));
+    r = calloc(1, sizeof(ccs_resampler_t));
+    if (!x || !e || !pix || !r) {
+        goto out;
+    }
+    if ((err = sort_axis(wl, npix, x, pix))) {
+        goto out;
+    }
+
+    r->nout = nout;
+    switch (method) {
+    case CCS_WL_LINEAR: r->ntaps = 2; break;
+    case CCS_WL_CUBIC:  r->ntaps = 4; break;
+    default:
+        pixel_edges(x, npix, e);
+        r->ntaps = area_weights(e, pix, npix, start, step, nout, NULL);
+        break;
+    }
+    r->idx = calloc(nout * r->ntaps, sizeof(uint32_t));
+    r->w = calloc(nout * r->ntaps, sizeof(ViReal64));
+    if (!r->idx || !r->w) {
+        err = VI_ERROR_SYSTEM_ERROR;
+        goto out;
+    }
+    if (method == CCS_WL_AREA) {
+        area_weights(e, pix, npix, start, step, nout, r);
+    } else {
+        interp_weights(x, pix, npix, start, step, method, r);
+    }
+
+    *rs = r;
+    r = NULL;
+    err = VI_SUCCESS;
+
+out:
+    CCSwl_resamplerFree(r);
+    free(pix);
+    free(e);
+    free(x);
+    return err;
+}
+
+
+void CCSwl_resample(const ccs_resampler_t *rs, const ViReal64 in[], ViReal64 out[]) {
+    const uint32_t *idx = rs->idx;
+    const ViReal64 *w = rs->w;
+    ViUInt32 o, k, n = rs->ntaps;
+    ViReal64 acc;
+
+    // fixed tap counts get straight-line bodies the compiler can unroll and vectorize
+    switch (n) {
+    case 2:
+        for (o = 0; o < rs->nout; o++, idx += 2, w += 2) {
+            out[o] = w[0] * in[idx[0]] + w[1] * in[idx[1]];
+        }
+        break;
+    case 4:
+        for (o = 0; o < rs->nout; o++, idx += 4, w += 4) {
+            out[o] = (w[0] * in[idx[0]] + w[1] * in[idx[1]]) + (w[2] * in[idx[2]] + w[3] * in[idx[3]]);
+        }
+        break;
+    default:
+        for (o = 0; o < rs->nout; o++, idx += n, w += n) {
+            acc = 0.0;
+            for (k = 0; k < n; k++) {
+                acc += w[k] * in[idx[k]];
+            }
+            out[o] = acc;
+        }
+        break;
+    }
+}
+
+
+void CCSwl_resamplerFree(ccs_resampler_t *rs) {
+    if (!rs) {
+        return;
+    }
+    free(rs->idx);
+    free(rs->w);
+    free(rs);
+}
+
+
+ViStatus CCSwl_indexCreate(const ViReal64 wl[], ViUInt32 npix, const ViReal64 poly[], ViUInt32 ncoef, ccs_wl_index_t **ix) {
+    ccs_wl_index_t *x;
+    ViUInt32 b, i = 0;
+    ViReal64 edge;
+    ViStatus err;
+
+    if (!wl || !ix || (npix < 2) || (poly && (!ncoef || (ncoef > WL_MAX_COEF)))) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    *ix = NULL;
+
+    if (!(x = calloc(1, sizeof(ccs_wl_index_t)))) {
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    // one bucket per pixel keeps every search to a step or two on a near-linear axis
+    x->npix = npix;
+    x->nbuckets = npix;
+    x->x = malloc(npix * sizeof(ViReal64));
+    x->pix = malloc(npix * sizeof(uint32_t));
+    x->bucket = malloc(x->nbuckets * sizeof(uint32_t));
+    if (!x->x || !x->pix || !x->bucket) {
+        CCSwl_indexFree(x);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    if ((err = sort_axis(wl, npix, x->x, x->pix))) {
+        CCSwl_indexFree(x);
+        return err;
+    }
+
+    x->xmin = x->x[0];
+    x->scale = x->nbuckets / (x->x[npix - 1] - x->xmin);
+    for (b = 0; b < x->nbuckets; b++) {
+        edge = x->xmin + b / x->scale;
+        while ((i < npix - 2) && (x->x[i + 1] <= edge)) {
+            i++;
+        }
+        x->bucket[b] = i;
+    }
+    if (poly) {
+        x->ncoef = ncoef;
+        memcpy(x->poly, poly, ncoef * sizeof(ViReal64));
+    }
+
+    *ix = x;
+    return VI_SUCCESS;
+}
+
+
+// i with x[i] <= l < x[i+1], l within the axis
+static ViUInt32 index_find(const ccs_wl_index_t *ix, ViReal64 l) {
+    ViUInt32 b, i;
+
+    b = (ViUInt32)((l - ix->xmin) * ix->scale);
+    if (b >= ix->nbuckets) {
+        b = ix->nbuckets - 1;
+    }
+    i = ix->bucket[b];
+    while ((i < ix->npix - 2) && (ix->x[i + 1] <= l)) {
+        i++;
+    }
+    return i;
+}
+
+
+static ViReal64 index_pixel(const ccs_wl_index_t *ix, ViReal64 l) {
+    ViUInt32 i = index_find(ix, l);
+    ViReal64 p0 = ix->pix[i], p1 = ix->pix[i + 1];
+    ViReal64 lo, hi, p, f, df, dp;
+    int n, k;
+
+    p = p0 + (p1 - p0) * (l - ix->x[i]) / (ix->x[i + 1] - ix->x[i]);
+    if (!ix->ncoef) {
+        return p;
+    }
+
+    lo = (p0 < p1) ? p0 : p1;
+    hi = (p0 < p1) ? p1 : p0;
+    for (n = 0; n < WL_NEWTON_ITER; n++) {
+        f = ix->poly[ix->ncoef - 1];
+        df = 0.0;
+        for (k = ix->ncoef - 2; k >= 0; k--) {
+            df = df * p + f;
+            f = f * p + ix->poly[k];
+        }
+        if (df == 0.0) {
+            break;
+        }
+        dp = (f - l) / df;
+        p -= dp;
+        if (p < lo) p = lo;
+        if (p > hi) p = hi;
+        if (fabs(dp) < 1e-9) {
+            break;
+        }
+    }
+    return p;
+}
+
+
+ViStatus CCSwl_pixel(const ccs_wl_index_t *ix, ViReal64 wavelength, ViReal64 *pixel) {
+    if (!(wavelength >= ix->x[0]) || !(wavelength <= ix->x[ix->npix - 1])) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    *pixel = index_pixel(ix, wavelength);
+    return VI_SUCCESS;
+}
+
+
+void CCSwl_pixels(const ccs_wl_index_t *ix, const ViReal64 wavelength[], ViUInt32 n, ViReal64 pixel[]) {
+    ViReal64 lo = ix->x[0], hi = ix->x[ix->npix - 1];
+    ViUInt32 i;
+
+    for (i = 0; i < n; i++) {
+        pixel[i] = ((wavelength[i] >= lo) && (wavelength[i] <= hi)) ? index_pixel(ix, wavelength[i]) : -1.0;
+    }
+}
+
+
+ViStatus CCSwl_window(const ccs_wl_index_t *ix, ViReal64 lo, ViReal64 hi, ViUInt32 *first, ViUInt32 *last) {
+    const ViReal64 *x = ix->x;
+    ViUInt32 n = ix->npix, j0, j1;
+
+    if (!(lo <= hi) || (hi < x[0]) || (lo > x[n - 1])) {
+        return VI_ERROR_INV_PARAMETER;
+    }
+    // j0..j1 in ascending order of wavelength
+    if (lo <= x[0]) {
+        j0 = 0;
+    } else {
+        j0 = index_find(ix, lo);
+        if (x[j0] < lo) j0++;
+    }
+    if (hi >= x[n - 1]) {
+        j1 = n - 1;
+    } else {
+        j1 = index_find(ix, hi);
+    }
+    if (j0 > j1) {
+        return VI_ERROR_INV_PARAMETER;  // window between two pixels
+    }
+    *first = (ix->pix[j0] < ix->pix[j1]) ? ix->pix[j0] : ix->pix[j1];
+    *last = (ix->pix[j0] < ix->pix[j1]) ? ix->pix[j1] : ix->pix[j0];
+    return VI_SUCCESS;
+}
+
+
+void CCSwl_indexFree(ccs_wl_index_t *ix) {
+    if (!ix) {
+        return;
+    }
+    free(ix->bucket);
+    free(ix->pix);
+    free(ix->x);
+    free(ix);
+}
@@ -0,0 +1,65 @@
+/* Wavelength axis utilities for CCS series spectrometers.
+ *
+ * The calibrated wavelength axis (CCSseries_getWavelengthData) is a cubic
+ * polynomial of the pixel number, so it is not uniform and differs from
+ * device to device. The resampler maps scans onto a common uniform grid.
+ * All interpolation weights and pixel indices are computed once per
+ * calibration, which leaves a short fixed-width gather per output point
+ * for every frame.
+ *
+ * The inverse index answers the opposite question, which pixel sits at a
+ * given wavelength, through a uniform bucket table over the axis instead of
+ * a search over all pixels. */
+#ifndef __ccswl_h__
+#define __ccswl_h__
+
+#include "vitypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// resampling methods
+#define CCS_WL_LINEAR       0   // linear interpolation between the two neighbouring pixels
+#define CCS_WL_CUBIC        1   // cubic Lagrange interpolation over the four nearest pixels
+#define CCS_WL_AREA         2   // rebinning; each output bin gets the pixel counts it overlaps,
+                                // so the sum over the grid equals the sum over the pixels covered
+
+typedef struct ccs_resampler ccs_resampler_t;
+
+/* Precomputes weights mapping a scan with wavelength axis wl[npix] (strictly
+ * increasing or decreasing, as from CCSseries_getWavelengthData) onto nout
+ * points start, start + step, ... Output points outside the axis come out as 0. */
+ViStatus CCSwl_resamplerCreate(const ViReal64 wl[], ViUInt32 npix, ViReal64 start, ViReal64 step, ViUInt32 nout, ViInt32 method, ccs_resampler_t **rs);
+
+/* Resamples one scan of npix values into nout values. */
+void CCSwl_resample(const ccs_resampler_t *rs, const ViReal64 in[], ViReal64 out[]);
+
+void CCSwl_resamplerFree(ccs_resampler_t *rs);
+
+
+typedef struct ccs_wl_index ccs_wl_index_t;
+
+/* Builds the inverse index of the axis wl[npix]. poly (ncoef coefficients,
+ * lowest order first, as from CCSseries_getWavelengthPoly) may be VI_NULL;
+ * with it fractional pixels are refined by Newton steps on the polynomial,
+ * without it they are interpolated linearly between neighbouring pixels. */
+ViStatus CCSwl_indexCreate(const ViReal64 wl[], ViUInt32 npix, const ViReal64 poly[], ViUInt32 ncoef, ccs_wl_index_t **ix);
+
+/* Fractional pixel number at wavelength; VI_ERROR_INV_PARAMETER outside the axis. */
+ViStatus CCSwl_pixel(const ccs_wl_index_t *ix, ViReal64 wavelength, ViReal64 *pixel);
+
+/* Same for n wavelengths at once; those outside the axis give -1.0. */
+void CCSwl_pixels(const ccs_wl_index_t *ix, const ViReal64 wavelength[], ViUInt32 n, ViReal64 pixel[]);
+
+/* First and last pixel whose wavelengths lie within [lo, hi];
+ * VI_ERROR_INV_PARAMETER if there are none. */
+ViStatus CCSwl_window(const ccs_wl_index_t *ix, ViReal64 lo, ViReal64 hi, ViUInt32 *first, ViUInt32 *last);
+
+void CCSwl_indexFree(ccs_wl_index_t *ix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
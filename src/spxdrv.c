@@ -53,6 +53,7 @@
 #include "vitypes.h"
 #include "spxusb.h"
 #include "spxdrv.h"
+#include "ccsgeom.h"
 #include "version.h"
 /* turn off windows twaddle */
 # define __declspec(dllexport)
@@ -231,6 +232,7 @@ typedef struct
 	ViInt32			user_cal_node_pixel[SPX_MAX_NUM_USR_ADJ]; //	pixel array of supporting points
 	ViReal64			user_cal_node_wl[SPX_MAX_NUM_USR_ADJ];		//	wavelength array of supporting points
 	
+	ViInt32			acqMode;			// SPX_ACQ_MODE_CHECKED or SPX_ACQ_MODE_FAST
 	ViUInt16 		rawScanData[SPX_PIXEL_BUFFER];
 	ViChar			spx_answer_buf[SPX_MAX_STD_ANSWER];
 	ViUInt16 		ReturnCount;
@@ -272,6 +274,9 @@ static ViStatus SPX_getFirmwareRevision (ViSession instr);
 static ViStatus SPX_getHardwareRevision (ViSession instr);
 static ViStatus SPX_acquireScanDataRaw (ViSession instr);
 static ViStatus SPX_ProcessScanData (SPX_data_t *data, ViReal64 _VI_FAR scanDataArray[]);
+
+// kernels for the readout of the SPX sensor: inverted, last pixel first
+CCS_GEOM_KERNELS(SPX, SPX_PIXEL_BUFFER, SPX_BLACK_START, SPX_BLACK_STOP - SPX_BLACK_START, SPX_SCAN_START, SPX_PIXEL_BUFFER - SPX_SCAN_START, SPX_MAX_ADC_VALUE, CCS_GEOM_REVERSED_INVERTED)
 static int LeastSquareInterpolation (int *x, double *y, int cnt, double *polyout);
 
 __declspec(dllexport) ViStatus SPX_writeEEPROM(ViSession instr, ViUInt16	wValue, ViUInt16 wIndex, ViUInt16 wLength, char	buffer[]);
@@ -343,6 +348,7 @@ ViStatus _VI_FUNC SPX_init (ViRsrc resource, ViInt32 timeout, ViPSession pInstr)
 
 	// store the given timeout value for later use
 	data->timeout = (ViAttrState)timeout;
+	data->acqMode = SPX_ACQ_MODE_CHECKED;
 
 	viGetAttribute(*pInstr, VI_ATTR_MANF_NAME, 		data->vendor);
 	viGetAttribute(*pInstr, VI_ATTR_MODEL_NAME,		data->name);
@@ -500,6 +506,45 @@ ViStatus _VI_FUNC SPX_getIntTime (ViSession instr, ViPReal64 intTime)
 
 
 
+/*---------------------------------------------------------------------------
+  Function: Set Acquisition Mode
+  Purpose:  selects how scan data is read from the Spectrometer
+				SPX_ACQ_MODE_CHECKED queries the bulk in pipe status with a
+				control transfer before every read, SPX_ACQ_MODE_FAST reads
+				right away and only asks for the pipe status after a failed
+				or timed out read, which saves one USB transaction per scan.
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC SPX_setAcquisitionMode (ViSession instr, ViInt32 mode)
+{
+	SPX_data_t 		*data;
+	ViStatus 		err;
+
+	if((mode != SPX_ACQ_MODE_CHECKED) && (mode != SPX_ACQ_MODE_FAST))	return VI_ERROR_PARAMETER2;
+
+	if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+
+	data->acqMode = mode;
+	return VI_SUCCESS;
+}
+
+
+/*---------------------------------------------------------------------------
+  Function: Get Acquisition Mode
+  Purpose:  gets back the scan data acquisition mode
+---------------------------------------------------------------------------*/
+ViStatus _VI_FUNC SPX_getAcquisitionMode (ViSession instr, ViPInt32 mode)
+{
+	SPX_data_t 		*data;
+	ViStatus 		err;
+
+	if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
+
+	*mode = data->acqMode;
+	return VI_SUCCESS;
+}
+
+
+
 /****************************************************************************
 
  Class: Status/Action Functions.
@@ -1072,17 +1117,20 @@ static ViStatus SPX_acquireScanDataRaw (ViSession instr)
 
 	if((err = viGetAttribute(instr, VI_ATTR_USER_DATA, &data)) != VI_SUCCESS) return err;
 
-	if((err = viGetAttribute (instr, VI_ATTR_USB_BULK_IN_STATUS, &in_pipe_status)) != VI_SUCCESS) return err;
-
-	switch (in_pipe_status)
+	if(data->acqMode != SPX_ACQ_MODE_FAST)
 	{
-		case VI_USB_PIPE_STATE_UNKNOWN	:
-														break;
-		case VI_USB_PIPE_READY				:
-														break;
-		case VI_USB_PIPE_STALLED			:
-														return VI_WARN_SPX_DATA_NOT_READY;
-														break;
+		if((err = viGetAttribute (instr, VI_ATTR_USB_BULK_IN_STATUS, &in_pipe_status)) != VI_SUCCESS) return err;
+
+		switch (in_pipe_status)
+		{
+			case VI_USB_PIPE_STATE_UNKNOWN	:
+															break;
+			case VI_USB_PIPE_READY				:
+															break;
+			case VI_USB_PIPE_STALLED			:
+															return VI_WARN_SPX_DATA_NOT_READY;
+															break;
+		}
 	}
 
 	// READOUT SCAN DATA
@@ -1099,6 +1147,11 @@ static ViStatus SPX_acquireScanDataRaw (ViSession instr)
 												return VI_WARN_SPX_DATA_NOT_READY;
 												break;
 		default							:
+												// fast mode: a stalled pipe only means there is no scan yet
+												if((data->acqMode == SPX_ACQ_MODE_FAST) &&
+													(viGetAttribute (instr, VI_ATTR_USB_BULK_IN_STATUS, &in_pipe_status) == VI_SUCCESS) &&
+													(in_pipe_status == VI_USB_PIPE_STALLED))
+													return VI_WARN_SPX_DATA_NOT_READY;
 												return err;
 												break;
 	}
@@ -1109,55 +1162,30 @@ static ViStatus SPX_acquireScanDataRaw (ViSession instr)
 /*---------------------------------------------------------------------------
   Function: Process Scan Data
   Purpose:  normalizes the scan data, corrects the scan with dark current
+				The ADC values are inverted and the pixels come in reverse
+				order. Both are folded into the arithmetic of the kernel
+				generated for this geometry, see ccsgeom.h.
 ---------------------------------------------------------------------------*/
 
 static ViStatus SPX_ProcessScanData (SPX_data_t *data, ViReal64 _VI_FAR scanDataArray[])
 {
-	ViUInt32			i;
-	ViReal64			*result;
-	ViUInt16			*scan;
-	ViReal64			norm_fact_even, norm_fact_odd, dark_even, dark_odd;
-
-	// invert all data
-	scan   = data->rawScanData;
-	for(i = 0; i < SPX_PIXEL_BUFFER; i++)
-	{
-		*scan = SPX_MAX_ADC_VALUE - *scan;
-		scan++;
-	}
+	ViUInt32			sum[2];
+	ViReal64			dark[2], norm[2];
 
-	// calculate even and odd average
-	dark_even = 0.0;
-	dark_odd = 0.0;
-	for(i = SPX_BLACK_START; i < SPX_BLACK_STOP; i+= 2)
-	{
-		dark_even += (ViReal64)(data->rawScanData[i]);
-		dark_odd  += (ViReal64)(data->rawScanData[i+1]);
-	}
-
-	dark_even /= 0.5 * (ViReal64)((SPX_BLACK_STOP - SPX_BLACK_START));
-	dark_odd  /= 0.5 * (ViReal64)((SPX_BLACK_STOP - SPX_BLACK_START));
+	// even and odd average of the inverted dark pixels
+	SPX_darkSums(data->rawScanData, sum);
+	dark[0] = (ViReal64)sum[0] / (0.5 * (ViReal64)(SPX_BLACK_STOP - SPX_BLACK_START));
+	dark[1] = (ViReal64)sum[1] / (0.5 * (ViReal64)(SPX_BLACK_STOP - SPX_BLACK_START));
 
 	// limit the Offset to values stored in SPX (retrieved from SPx during init()-routine)
-	if(dark_even > data->Offset_Even_Max)	dark_even = data->Offset_Even_Max;
-	if(dark_odd  > data->Offset_Odd_Max)	dark_odd  = data->Offset_Odd_Max;
-
+	if(dark[0] > data->Offset_Even_Max)	dark[0] = data->Offset_Even_Max;
+	if(dark[1] > data->Offset_Odd_Max)	dark[1] = data->Offset_Odd_Max;
 
 	// calculate the array with respect of the dark values
-	result = scanDataArray;
-	norm_fact_even = 1.0 / ((ViReal64)SPX_MAX_ADC_VALUE - dark_even);
-	norm_fact_odd  = 1.0 / ((ViReal64)SPX_MAX_ADC_VALUE - dark_odd );
+	norm[0] = 1.0 / ((ViReal64)SPX_MAX_ADC_VALUE - dark[0]);
+	norm[1] = 1.0 / ((ViReal64)SPX_MAX_ADC_VALUE - dark[1]);
 
-	for(i = 0; i < (SPX_PIXEL_BUFFER - SPX_SCAN_START); i+= 2)
-	{
-		*result = ((ViReal64)data->rawScanData[SPX_PIXEL_BUFFER - 1 - i] - dark_even) * norm_fact_even;
-		if(*result < 0.0) *result = 0.0;
-		result++;
-
-		*result = ((ViReal64)data->rawScanData[SPX_PIXEL_BUFFER - 2 - i] - dark_odd) * norm_fact_odd;
-		if(*result < 0.0) *result = 0.0;
-		result++;
-	}
+	SPX_procClampedFlat(data->rawScanData, dark, norm, scanDataArray);
 
 	return VI_SUCCESS;
 }
@@ -79,6 +79,13 @@ extern "C"
 ---------------------------------------------------------------------------*/
 #define SPX_VI_FIND_RSC_PATTERN			"USB?*?{VI_ATTR_MANF_ID==0x1313 && ((VI_ATTR_MODEL_CODE==0x0111) || (VI_ATTR_MODEL_CODE==0x0112))}"
 
+/*---------------------------------------------------------------------------
+ USB VIDs and PIDs
+---------------------------------------------------------------------------*/
+#define SPX_VID								0x1313					// Thorlabs
+#define SP1_USB_PID							0x0111					// SP1-USB Spectrometer
+#define SP2_USB_PID							0x0112					// SP2-USB Spectrometer
+
 
 /*---------------------------------------------------------------------------
  Communication timeout
@@ -103,6 +110,10 @@ extern "C"
 #define SPX_CAL_DATA_SET_FACTORY			0
 #define SPX_CAL_DATA_SET_USER				1
 
+	//	scan data acquisition modes - see SPX_setAcquisitionMode();
+#define SPX_ACQ_MODE_CHECKED				0			// query the pipe status before every read (default)
+#define SPX_ACQ_MODE_FAST					1			// read right away, query the pipe status only after a failed read
+
 /*---------------------------------------------------------------------------
  GLOBAL USER-CALLABLE FUNCTION DECLARATIONS (Exportable Functions)
 ---------------------------------------------------------------------------*/
@@ -119,6 +130,8 @@ ViStatus _VI_FUNC SPX_close (ViSession instrument);
 // Configuration functions
 ViStatus _VI_FUNC SPX_setIntTime (ViSession instr, ViReal64 time);
 ViStatus _VI_FUNC SPX_getIntTime (ViSession instr, ViPReal64 time);
+ViStatus _VI_FUNC SPX_setAcquisitionMode (ViSession instr, ViInt32 mode);
+ViStatus _VI_FUNC SPX_getAcquisitionMode (ViSession instr, ViPInt32 mode);
 
 // Action/Status functions
 ViStatus _VI_FUNC SPX_startScan (ViSession instr);
@@ -1,10 +1,15 @@
 /* low level communications with SPx device */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <usb.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "vitypes.h"
 #include "spxusb.h"
 
@@ -12,9 +17,22 @@
 #define SPX_BUFFER_SIZE            256
 #define SPX_ERR_DESCR_BUFFER_SIZE  512
 
-/* There's no point in passing session data around. I only care about one
- * device, opened once */
+#define MAX_SESSIONS    16      // devices open at the same time
+#define MAX_DEVICES     32      // matching devices remembered from a bus scan
+#define RM_SESSION      0x100   // dummy resource manager handle, outside the session numbers
+#define SERIAL_LEN      64
+
+#define FRAME_BYTES     (3694 * 2)  // largest bulk frame, a CCS scan; SPx frames are 3068 words
+#define DRAIN_TIMEOUT   5           // ms without data after which the bulk in pipe counts as empty
+#define DRAIN_MAX       32          // frames thrown away at most, a scanning device never runs dry
+
+#define AHEAD_FRAMES    4           // frames the reader thread keeps, the oldest is dropped when full
+#define AHEAD_TIMEOUT   100         // ms per reader bulk read, bounds how long stopping the reader takes
+
+/* One per open device; the ViSession handed out is the index + 1 */
 struct session {
+        int open;
+        struct usb_device *dev;
         int timeout;
         struct usb_dev_handle *usbhandle;
         int bulk_in_pipe;
@@ -24,104 +42,601 @@ struct session {
         unsigned short vid;
         unsigned short pid;
         int usbtimeout;
+        int bulk_in_state;  // VI_USB_PIPE_STALLED after a read failed with EPIPE, else unknown
+        int lost;           // the device went away, only viReconnect or viClose help
+        char serial[SERIAL_LEN];  // to find the same unit again in viReconnect
+
+        // read ahead for viTryRead: a thread keeps reading frames into a small queue
+        pthread_t reader;
+        pthread_mutex_t lock;
+        pthread_cond_t ready;
+        int reader_started;     // thread exists and has to be joined
+        int reader_run;         // cleared to stop it, or by the thread itself after an error
+        ViStatus reader_err;    // why it stopped
+        ViUInt32 frame_size;
+        unsigned char *frames;  // AHEAD_FRAMES * frame_size
+        ViUInt32 frame_len[AHEAD_FRAMES];
+        int head;               // oldest queued frame
+        int count;
+        int event_fd;           // counts queued frames plus a stop error, -1 until viGetReadEventFd
+        ViReal64 frame_time[AHEAD_FRAMES];  // CLOCK_MONOTONIC arrival of each queued frame
+        ViUInt32 discarded;     // frames dropped unread because the queue was full, since viOpen
+        ViReal64 read_time;     // arrival of the frame viRead or viTryRead handed out last
+
+        // burst capture: until burst_done reaches burst_n the reader reads
+        // straight into burst_buf instead of the queue
+        unsigned char *burst_buf;   // burst_n frames of frame_size
+        ViReal64 *burst_time;       // CLOCK_MONOTONIC arrival of each, may be NULL
+        ViUInt32 burst_n;
+        ViUInt32 burst_done;
+        ViStatus burst_err;         // why a burst ended early
+};
+
+static struct session sessions[MAX_SESSIONS];
+
+/* Result of the last bus scan, kept so that opening several devices or
+ * looking them up by serial number does not walk the bus every time.
+ * libusb keeps the usb_device structures alive until the next scan. */
+struct cached_device {
+        struct usb_device *dev;
+        unsigned short vid;
+        unsigned short pid;
+        char serial[SERIAL_LEN];
 };
 
-static struct session sess;
+static struct cached_device devices[MAX_DEVICES];
+static int ndevices;
+static int scanned;
+static int usb_ready;
+
+/* viFindRsrc results, handed out by viFindNext */
+static char found[MAX_DEVICES][VI_FIND_BUFLEN];
+static int nfound;
+static int nextfound;
+
+/* Held by everything that claims or frees a session or touches the device
+ * cache, the found list or the bus: libusb-0.1 bus scans are not thread
+ * safe, and two viOpen calls must not take the same free slot. I/O on an
+ * open session does not take it. */
+static pthread_mutex_t rm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static struct session *get_session(ViObject vi) {
+    if ((vi < 1) || (vi > MAX_SESSIONS) || !sessions[vi - 1].open) {
+        return NULL;
+    }
+    return &sessions[vi - 1];
+}
+
+
+/* Status for a failed libusb call. ENODEV means the device was unplugged or
+ * reset and the handle is dead; the session is marked lost so that further
+ * calls fail at once instead of each waiting for the USB timeout. */
+static ViStatus usb_error(struct session *s, int ret, ViStatus err) {
+    if (ret == -ENODEV) {
+        s->lost = 1;
+        return VI_ERROR_CONN_LOST;
+    }
+    return err;
+}
+
+
+/* Reads and throws away whatever is waiting in the bulk in pipe, with a
+ * short timeout per read so that an empty pipe costs a few ms instead of
+ * the session timeout. */
+static ViStatus drain(struct session *s) {
+    char buf[FRAME_BYTES];
+    int i, ret;
+
+    for (i = 0; i < DRAIN_MAX; i++) {
+        ret = usb_bulk_read(s->usbhandle, s->bulk_in_pipe, buf, sizeof(buf), DRAIN_TIMEOUT);
+        if (ret == -ETIMEDOUT) {
+            return VI_SUCCESS;
+        }
+        if (ret < 0) {
+            return usb_error(s, ret, VI_ERROR_IO);
+        }
+    }
+    return VI_SUCCESS;
+}
+
+
+/* The event fd of a session is an eventfd semaphore: it is readable while
+ * frames are queued or the reader stopped with an error not yet reported.
+ * Both are only called with the session locked. */
+static void event_post(struct session *s) {
+    uint64_t one = 1;
+
+    if (s->event_fd >= 0) {
+        if (write(s->event_fd, &one, sizeof(one)) < 0) {
+            // cannot overflow at a handful of counts, nothing to do
+        }
+    }
+}
+
+static void event_take(struct session *s) {
+    uint64_t one;
+
+    if (s->event_fd >= 0) {
+        if (read(s->event_fd, &one, sizeof(one)) < 0) {
+            // already zero, nonblocking
+        }
+    }
+}
+
+
+// CLOCK_MONOTONIC in seconds, the time base of frame arrivals
+static ViReal64 monotonic(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+/* A new read is posted as soon as the last one returned, so the device
+ * always has somewhere to put its next frame. */
+static void *reader_main(void *arg) {
+    struct session *s = arg;
+    unsigned char *buf = malloc(s->frame_size);
+    unsigned char *dst;
+    ViReal64 now;
+    int ret, run = 1, tail;
+
+    while (run) {
+        pthread_mutex_lock(&s->lock);
+        dst = (s->burst_done < s->burst_n) ? s->burst_buf + s->burst_done * s->frame_size : buf;
+        pthread_mutex_unlock(&s->lock);
+
+        ret = dst ? usb_bulk_read(s->usbhandle, s->bulk_in_pipe, (char*)dst, s->frame_size, AHEAD_TIMEOUT) : -ENOMEM;
+        now = monotonic();
+
+        pthread_mutex_lock(&s->lock);
+        if ((ret >= 0) && (dst != buf)) {
+            if ((ViUInt32)ret == s->frame_size) {
+                if (s->burst_time) {
+                    s->burst_time[s->burst_done] = now;
+                }
+                s->burst_done++;
+            } else {
+                // a burst holds whole frames only
+                s->burst_n = s->burst_done;
+                s->burst_err = VI_ERROR_IO;
+            }
+            pthread_cond_broadcast(&s->ready);
+        } else if (ret >= 0) {
+            if (s->count == AHEAD_FRAMES) {
+                // nobody picked up the oldest, the newest is worth more
+                s->head = (s->head + 1) % AHEAD_FRAMES;
+                s->count--;
+                s->discarded++;
+                event_take(s);
+            }
+            tail = (s->head + s->count) % AHEAD_FRAMES;
+            memcpy(s->frames + tail * s->frame_size, buf, ret);
+            s->frame_len[tail] = ret;
+            s->frame_time[tail] = now;
+            s->count++;
+            event_post(s);
+            pthread_cond_broadcast(&s->ready);
+        } else if (ret != -ETIMEDOUT) {
+            if (ret == -EPIPE) {
+                s->bulk_in_state = VI_USB_PIPE_STALLED;
+            }
+            s->reader_err = (ret == -ENOMEM) ? VI_ERROR_SYSTEM_ERROR : usb_error(s, ret, VI_ERROR_IO);
+            s->reader_run = 0;
+            event_post(s);
+            pthread_cond_broadcast(&s->ready);
+        }
+        run = s->reader_run;
+        pthread_mutex_unlock(&s->lock);
+    }
+    free(buf);
+    return NULL;
+}
+
+
+static void stop_reader(struct session *s) {
+    uint64_t n;
+
+    if (!s->reader_started) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->reader_run = 0;
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+
+    // nothing queued any more
+    if (s->event_fd >= 0) {
+        while (read(s->event_fd, &n, sizeof(n)) > 0)
+            ;
+    }
+    free(s->frames);
+    s->frames = NULL;
+    s->count = 0;
+    s->reader_started = 0;
+
+    // nobody reads into the burst buffer any more
+    if (s->burst_done < s->burst_n) {
+        s->burst_n = s->burst_done;
+        s->burst_err = VI_ERROR_ABORT;
+    }
+}
+
+
+static ViStatus start_reader(struct session *s, ViUInt32 size);
+
+/* After stopping the reader to talk to the pipe directly: a caller waiting
+ * on the event fd would never hear of new frames, so start it again. */
+static ViStatus resume_reader(struct session *s) {
+    if ((s->event_fd < 0) || !s->frame_size) {
+        return VI_SUCCESS;
+    }
+    return start_reader(s, s->frame_size);
+}
+
+
+static ViStatus start_reader(struct session *s, ViUInt32 size) {
+    stop_reader(s);
+    if (!(s->frames = malloc(AHEAD_FRAMES * size))) {
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    s->frame_size = size;
+    s->head = 0;
+    s->count = 0;
+    s->reader_err = VI_SUCCESS;
+    s->reader_run = 1;
+    if (pthread_create(&s->reader, NULL, reader_main, s)) {
+        free(s->frames);
+        s->frames = NULL;
+        s->reader_run = 0;
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    s->reader_started = 1;
+    return VI_SUCCESS;
+}
+
+
+// absolute time ms from now, for pthread_cond_timedwait
+static void deadline(struct timespec *until, int ms) {
+    clock_gettime(CLOCK_REALTIME, until);
+    until->tv_sec += ms / 1000;
+    until->tv_nsec += (ms % 1000) * 1000000L;
+    if (until->tv_nsec >= 1000000000L) {
+        until->tv_sec++;
+        until->tv_nsec -= 1000000000L;
+    }
+}
+
+
+/* Hands out the oldest frame the reader queued, waiting up to wait ms for
+ * one. After the reader stopped on an error, the error is returned once
+ * and the thread is joined; the next call starts a new one. */
+static ViStatus take_frame(struct session *s, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt, int wait) {
+    struct timespec until;
+    ViUInt32 len;
+    ViStatus err;
+
+    deadline(&until, wait);
+    pthread_mutex_lock(&s->lock);
+    while (wait && !s->count && s->reader_run) {
+        if (pthread_cond_timedwait(&s->ready, &s->lock, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (s->count) {
+        len = (s->frame_len[s->head] < cnt) ? s->frame_len[s->head] : cnt;
+        memcpy(buf, s->frames + s->head * s->frame_size, len);
+        s->read_time = s->frame_time[s->head];
+        s->head = (s->head + 1) % AHEAD_FRAMES;
+        s->count--;
+        event_take(s);
+        pthread_mutex_unlock(&s->lock);
+        *retCnt = len;
+        return VI_SUCCESS;
+    }
+    if (!s->reader_run) {
+        err = s->reader_err;
+        event_take(s);
+        pthread_mutex_unlock(&s->lock);
+        stop_reader(s);
+        return err;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return wait ? VI_ERROR_TMO : VI_SUCCESS_QUEUE_EMPTY;
+}
+
+
+static struct session *session_of_device(struct usb_device *dev) {
+    int i;
+
+    for (i = 0; i < MAX_SESSIONS; i++) {
+        if (sessions[i].open && (sessions[i].dev == dev)) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+
+/* Walks the bus once and remembers every device of vendor vid with one of
+ * the npid product ids (all products if npid is 0), serial number included.
+ * Called with rm_lock held. */
+static int scan_bus(unsigned short vid, const unsigned short pids[], int npid) {
+    struct usb_bus *bus;
+    struct usb_device *dev;
+    struct usb_dev_handle *h;
+    struct session *s;
+    int i, match;
+
+    if (!usb_ready) {
+        usb_init();
+        usb_ready = 1;
+    }
+    if (usb_find_busses() < 0) {
+        fprintf(stderr, "Failed to access /[dev|proc]/bus/usb\n");
+        return -1;
+    }
+    usb_find_devices();
+    scanned = 1;
+
+    ndevices = 0;
+    for (bus = usb_get_busses(); bus; bus = bus->next) {
+        for (dev = bus->devices; dev && (ndevices < MAX_DEVICES); dev = dev->next) {
+            if (dev->descriptor.idVendor != vid) {
+                continue;
+            }
+            match = !npid;
+            for (i = 0; i < npid; i++) {
+                match |= (dev->descriptor.idProduct == pids[i]);
+            }
+            if (!match) {
+                continue;
+            }
+            devices[ndevices].dev = dev;
+            devices[ndevices].vid = dev->descriptor.idVendor;
+            devices[ndevices].pid = dev->descriptor.idProduct;
+            devices[ndevices].serial[0] = 0;
+            // a device we have open can be asked through its own handle
+            if ((s = session_of_device(dev))) {
+                usb_get_string_simple(s->usbhandle, dev->descriptor.iSerialNumber,
+                                      devices[ndevices].serial, SERIAL_LEN);
+            } else if ((h = usb_open(dev))) {
+                usb_get_string_simple(h, dev->descriptor.iSerialNumber,
+                                      devices[ndevices].serial, SERIAL_LEN);
+                usb_close(h);
+            }
+            ndevices++;
+        }
+    }
+    return ndevices;
+}
+
+
+/* The cached device matching vid:pid and, if given, the serial number that
+ * is not open yet. The bus is scanned if nothing was cached or found.
+ * Called with rm_lock held. */
+static struct cached_device *lookup_device(unsigned short vid, unsigned short pid, const char *serial) {
+    int i, pass;
+
+    for (pass = scanned ? 0 : 1; pass < 2; pass++) {
+        if (pass && (scan_bus(vid, &pid, 1) < 0)) {
+            return NULL;
+        }
+        for (i = 0; i < ndevices; i++) {
+            if ((devices[i].vid == vid) && (devices[i].pid == pid) &&
+                (!serial[0] || !strcmp(devices[i].serial, serial)) &&
+                !session_of_device(devices[i].dev)) {
+                return &devices[i];
+            }
+        }
+    }
+    return NULL;
+}
 
 
 // called from SPX_init
 ViStatus viOpenDefaultRM(ViPSession vi){
         // No need for this, so give it a dummy handle
-        *vi = (ViSession)2;
+        *vi = (ViSession)RM_SESSION;
         return VI_SUCCESS;
 }
 
 // called from SPX_init -- we find the USB device and stash its parameters
 // in the ViSession
 // Our syntax for the name is just hex:hex vid:pid[:optionalserial]  -- not the same as VISA
+// Without a serial the first device of that type that is not open yet is taken.
 ViStatus viOpen(ViSession sesn, ViRsrc name, ViAccessMode mode,
                                     ViUInt32 timeout, ViPSession vi){
     unsigned short vid, pid;
+    char serial[SERIAL_LEN];
+    struct cached_device *cd;
+    struct session *s;
+    int i, n;
+
     vid = 0;
     pid = 0;
-    // Ignore the serial for now. sscanf is happy if not there.   Maybe match it one day.
-    sscanf(name, "%hx:%hx", &vid, &pid);
-    sess.usbhandle = find_usb_device(vid, pid);
-    if (! sess.usbhandle) {
+    serial[0] = 0;
+    n = 0;
+    sscanf(name, "%hx:%hx%n", &vid, &pid, &n);
+    if (n && (name[n] == ':')) {
+        strncpy(serial, name + n + 1, SERIAL_LEN - 1);
+        serial[SERIAL_LEN - 1] = 0;
+    }
+
+    // slot and device are both claimed under the lock
+    pthread_mutex_lock(&rm_lock);
+    for (i = 0; (i < MAX_SESSIONS) && sessions[i].open; i++)
+        ;
+    if (i == MAX_SESSIONS) {
+        pthread_mutex_unlock(&rm_lock);
+        return VI_ERROR_SYSTEM_ERROR;
+    }
+    s = &sessions[i];
+    memset(s, 0, sizeof(*s));
+    s->event_fd = -1;
+
+    if (!(cd = lookup_device(vid, pid, serial))) {
+        pthread_mutex_unlock(&rm_lock);
+        fprintf(stderr, "Device not found on USB\n");
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    if (!(s->usbhandle = usb_open(cd->dev))) {
+        pthread_mutex_unlock(&rm_lock);
         return VI_ERROR_RSRC_NFOUND;
     }
-    if(usb_claim_interface(sess.usbhandle, 0)) {
+    if(usb_claim_interface(s->usbhandle, 0)) {
+        usb_close(s->usbhandle);
+        pthread_mutex_unlock(&rm_lock);
         return VI_ERROR_RSRC_BUSY;
     } 
-    sess.timeout = timeout;  /// TODO this may be only for this function; may be set to null so use something else for usb
-    sess.usbtimeout = 3000;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->ready, NULL);
+    s->open = 1;
+    s->dev = cd->dev;
+    strcpy(s->serial, cd->serial);
+    s->bulk_in_state = VI_USB_PIPE_STATE_UNKNOWN;
+    s->timeout = timeout;  /// TODO this may be only for this function; may be set to null so use something else for usb
+    s->usbtimeout = 3000;
     
     // Stash for viGetAttribute calls
-    sess.vid = vid;
-    sess.pid = pid;
+    s->vid = vid;
+    s->pid = pid;
+    pthread_mutex_unlock(&rm_lock);
     
-    *vi = (ViSession)1;
+    *vi = (ViSession)(i + 1);
     return VI_SUCCESS;
 }
 
 
 // called from  SPX_init (cleanup)  SPX_initCleanUp  SPX_initClose
 ViStatus viClose (ViObject vi){
-        if (vi == 1) {  // the main session
-            usb_release_interface(sess.usbhandle, 0);
-            usb_reset(sess.usbhandle);
-            usb_close(sess.usbhandle);
+        struct session *s;
+
+        pthread_mutex_lock(&rm_lock);
+        if ((s = get_session(vi))) {
+            stop_reader(s);
+            if (s->usbhandle) {
+                usb_release_interface(s->usbhandle, 0);
+                usb_reset(s->usbhandle);
+                usb_close(s->usbhandle);
+            }
+            if (s->event_fd >= 0) {
+                close(s->event_fd);
+            }
+            pthread_cond_destroy(&s->ready);
+            pthread_mutex_destroy(&s->lock);
+            s->open = 0;
+            // the reset makes the device enumerate again
+            scanned = 0;
         }
+        pthread_mutex_unlock(&rm_lock);
     return VI_SUCCESS;
 }
 
-// called from CCSseries_init
+// viReconnect with rm_lock held
+static ViStatus reconnect(struct session *s) {
+    struct cached_device *cd;
+    struct usb_dev_handle *h;
+
+    stop_reader(s);
+    // the old handle is dead, let go of it
+    if (s->usbhandle) {
+        usb_release_interface(s->usbhandle, 0);
+        usb_close(s->usbhandle);
+        s->usbhandle = NULL;
+    }
+    s->lost = 1;
+    s->dev = NULL;
+    scanned = 0;
+
+    if (!(cd = lookup_device(s->vid, s->pid, s->serial))) {
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    if (!(h = usb_open(cd->dev))) {
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    if (usb_claim_interface(h, 0)) {
+        usb_close(h);
+        return VI_ERROR_RSRC_BUSY;
+    }
+    s->usbhandle = h;
+    s->dev = cd->dev;
+    s->bulk_in_state = VI_USB_PIPE_STATE_UNKNOWN;
+    s->lost = 0;
+    return resume_reader(s);
+}
+
+// not VISA -- called from CCSseries_recover after VI_ERROR_CONN_LOST
+// Opens the unit with the serial number of the session again after it was
+// unplugged or reset. The ViSession, its user data, pipes and timeouts stay
+// as they were, so the caller only has to restore the device settings.
+// VI_ERROR_RSRC_NFOUND while the device is not back on the bus yet.
+ViStatus viReconnect(ViSession vi) {
+    struct session *s;
+    ViStatus err = VI_ERROR_INV_OBJECT;
+
+    pthread_mutex_lock(&rm_lock);
+    if ((s = get_session(vi))) {
+        err = reconnect(s);
+    }
+    pthread_mutex_unlock(&rm_lock);
+    return err;
+}
+
+// called from CCSseries_init, after the pipes are set
+// Gets the device out of whatever state an unclean shutdown left it in:
+// clears a halt on both bulk pipes and drains stale frames.
+// The USBTMC INITIATE_CLEAR request VISA would send is not understood by
+// these devices (the control transfer fails with EPIPE).
 ViStatus viClear(ViSession vi) {
-///        TODO implement me  - I have no idea whether this null implementation works
-        return VI_SUCCESS;
-        
-        /* The visa manual says VISA must send the INITIATE_CLEAR and CHECK_CLEAR_STATUS commands on the control pipe.
-         * http://svn.openmoko.org/developers/werner/ahrt/host/tmc/usbtmc.c dose something like this
-         * Unfortunately, what I have here gives a -32 broken pipe error at the usb_control_msg.
-        
-        nbytes = usb_control_msg(sess.usbhandle, 
-        0xA1,         //USB_ENDPOINT_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE  // req type
-        0x5,          //INITIATE_CLEAR,           //bRequest 
-        0,            //wValue, 
-        0,            //wIndex,   (interface number)
-        buf, 
-        1,            //wLength,
-        sess.usbtimeout);
-        
-        if (nbytes < 0) {
-            printf("INITIATE_CLEAR failed %d\n", nbytes);    // -32 broken pipe
-            printf("INITIATE_CLEAR status? 0x%02x\n", buf[0]);
-            printf("strerror says %s\n", usb_strerror());
-            return VI_ERROR_IO;
-        }
-        printf("INITIATE_CLEAR status 0x%02x\n", buf[0]);
-        /// TODO loop on CHECK_CLEAR_STATUS  then flush bulk
-        return VI_SUCCESS;
-        */
+        int ret;
+        ViStatus err;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        if (s->lost) {
+            return VI_ERROR_CONN_LOST;
+        }
+        stop_reader(s);
+        if ((ret = usb_clear_halt(s->usbhandle, s->bulk_in_pipe)) < 0) {
+            return usb_error(s, ret, VI_ERROR_IO);
+        }
+        if ((ret = usb_clear_halt(s->usbhandle, s->bulk_out_pipe)) < 0) {
+            return usb_error(s, ret, VI_ERROR_IO);
+        }
+        s->bulk_in_state = VI_USB_PIPE_STATE_UNKNOWN;
+        if ((err = drain(s))) {
+            return err;
+        }
+        return resume_reader(s);
 }
 
 // called from   SPX_init(setting usb params, data locn)
 ViStatus viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue){
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
         switch (attrName) {
         case VI_ATTR_TMO_VALUE:
-            sess.timeout = attrValue;
+            s->timeout = attrValue;
             break; 
         case VI_ATTR_USB_BULK_IN_PIPE:
-            sess.bulk_in_pipe = attrValue;
+            s->bulk_in_pipe = attrValue;
             break;
         case VI_ATTR_USB_BULK_OUT_PIPE:
-            sess.bulk_out_pipe = attrValue;
+            s->bulk_out_pipe = attrValue;
             break;
         case VI_ATTR_USB_END_IN:
-            sess.usb_end_in = attrValue;  // what is this? (4) not used anywhere - maybe usb wants it?
+            s->usb_end_in = attrValue;  // what is this? (4) not used anywhere - maybe usb wants it?
             break; 
         case VI_ATTR_USER_DATA:
-            sess.user_data = (void*)attrValue;  // a ptr that we are saving  
+            s->user_data = (void*)attrValue;  // a ptr that we are saving  
             break;
         default:
             return VI_ERROR_INV_PARAMETER;
@@ -134,47 +649,63 @@ ViStatus viGetAttribute(ViObject vi, ViAttr attrName, void *attrValue){
 int ret;
     char statusdata[2];
     struct usb_device *dev;
-    dev = usb_device(sess.usbhandle);
+    struct session *s = get_session(vi);
+
+    if (!s) {
+        return VI_ERROR_INV_OBJECT;
+    }
+    dev = s->dev;
+    // without the device only what is kept in the session can be answered
+    if (s->lost && (attrName != VI_ATTR_USER_DATA) && (attrName != VI_ATTR_MANF_ID) &&
+        (attrName != VI_ATTR_MODEL_CODE) && (attrName != VI_ATTR_RM_SESSION)) {
+        return VI_ERROR_CONN_LOST;
+    }
         
     switch (attrName) {
         case VI_ATTR_USER_DATA:
-            *(void**)attrValue = sess.user_data;
+            *(void**)attrValue = s->user_data;
             break;
             
         case VI_ATTR_MANF_ID:
-                *(short*)attrValue = sess.vid;
+                *(short*)attrValue = s->vid;
             break;
             
         case VI_ATTR_MODEL_CODE:
-                *(short*)attrValue = sess.pid;
+                *(short*)attrValue = s->pid;
             break;
             
         case VI_ATTR_MANF_NAME: 
-            usb_get_string_simple(sess.usbhandle, dev->descriptor.iManufacturer,
+            usb_get_string_simple(s->usbhandle, dev->descriptor.iManufacturer,
                                              (char*)attrValue, SPX_BUFFER_SIZE);
             break;
         case VI_ATTR_MODEL_NAME:
-            usb_get_string_simple(sess.usbhandle, dev->descriptor.iProduct,
+            usb_get_string_simple(s->usbhandle, dev->descriptor.iProduct,
                                              (char*)attrValue, SPX_BUFFER_SIZE);
             break;
         case VI_ATTR_USB_SERIAL_NUM:
-            usb_get_string_simple(sess.usbhandle, dev->descriptor.iSerialNumber,
+            usb_get_string_simple(s->usbhandle, dev->descriptor.iSerialNumber,
                                              (char*)attrValue, SPX_BUFFER_SIZE);        
             break;
 
         case VI_ATTR_USB_BULK_IN_STATUS:
+            // the last read already told us, no need to ask the device
+            if (s->bulk_in_state == VI_USB_PIPE_STALLED) {
+                s->bulk_in_state = VI_USB_PIPE_STATE_UNKNOWN;
+                *(ViInt16*)attrValue = VI_USB_PIPE_STALLED;
+                return VI_SUCCESS;
+            }
             // getstatus request
-            ret = usb_control_msg(sess.usbhandle, 
+            ret = usb_control_msg(s->usbhandle, 
                 USB_ENDPOINT_IN|USB_TYPE_STANDARD|USB_RECIP_ENDPOINT, // bmRequesttype
                 USB_REQ_GET_STATUS, // bRequest
                 0,  // wValue 
-                sess.bulk_in_pipe, // wIndex 
+                s->bulk_in_pipe, // wIndex 
                 statusdata, // bytes returned
                 2,          // size of return data
-                sess.timeout);
+                s->timeout);
             if (ret < 0) {
                 *(ViInt16*)attrValue = VI_USB_PIPE_STATE_UNKNOWN;
-                return VI_ERROR_IO;
+                return usb_error(s, ret, VI_ERROR_IO);
             }
             if (statusdata[0] & 1) {  // halt bit
                 *(ViInt16*)attrValue = VI_USB_PIPE_STALLED;
@@ -185,7 +716,7 @@ int ret;
             break;
            
         case VI_ATTR_RM_SESSION:  // return the dummy rmsession variable
-            *(ViSession*)attrValue = (ViSession)2; 
+            *(ViSession*)attrValue = (ViSession)RM_SESSION; 
             break;
             
         default:
@@ -194,15 +725,26 @@ int ret;
     return VI_SUCCESS;
 }
 
-// called from    SPX_reset  to clean out buffers
+// called from    SPX_reset, CCSseries_reset  to clean out buffers
+// Only the read buffer exists here, there is nothing to do for the write masks.
 ViStatus viFlush(ViSession vi, ViUInt16 mask){
-        char buf[3068 * 2];
-    usb_bulk_read(sess.usbhandle,
-                      sess.bulk_in_pipe,
-                      buf,
-                      3068 * 2,
-                      sess.timeout);  // throw away any result
-        return VI_SUCCESS;
+        ViStatus err;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        if (s->lost) {
+            return VI_ERROR_CONN_LOST;
+        }
+        if (!(mask & (VI_READ_BUF | VI_READ_BUF_DISCARD))) {
+            return VI_SUCCESS;
+        }
+        stop_reader(s);
+        if ((err = drain(s))) {
+            return err;
+        }
+        return resume_reader(s);
 }
 
 // called from   SPX_errorMessage
@@ -229,6 +771,18 @@ ViStatus viStatusDesc(ViObject vi, ViStatus status, ViChar desc[]){
         case VI_ERROR_TMO:
             msgtext = "device timed out";
             break;
+        case VI_ERROR_CONN_LOST:
+            msgtext = "device disconnected";
+            break;
+        case VI_ERROR_ABORT:
+            msgtext = "burst aborted";
+            break;
+        case VI_ERROR_NPERMISSION:
+            msgtext = "not permitted";
+            break;
+        case VI_SUCCESS_QUEUE_EMPTY:
+            msgtext = "no data buffered yet";
+            break;
         case VI_SUCCESS:
             msgtext = "lowlevel no error";
             break;
@@ -250,36 +804,214 @@ ViStatus viStatusDesc(ViObject vi, ViStatus status, ViChar desc[]){
 ViStatus viRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt){
         // ViPbuf is unsigned char*, so almost ready for usb_bulk_read
         int nread;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        if (s->lost) {
+            return VI_ERROR_CONN_LOST;
+        }
+        // frames are being read ahead, wait for the next one of them
+        if (s->reader_started) {
+            if (s->frame_size == cnt) {
+                return take_frame(s, buf, cnt, retCnt, s->usbtimeout);
+            }
+            stop_reader(s);
+        }
         
         // some googling suggests viRead is supposed to send a bulk write
         // to specify max size of data first.  Does not seem to be needed.
         
-        nread = usb_bulk_read(sess.usbhandle,
-                      sess.bulk_in_pipe,
+        nread = usb_bulk_read(s->usbhandle,
+                      s->bulk_in_pipe,
                       (char*)buf,    // cast to signed
                       cnt,    // will be 3068 * 2
-                      sess.usbtimeout);    ///TODO watch out may not be correct
+                      s->usbtimeout);    ///TODO watch out may not be correct
         
         if (nread == -ETIMEDOUT) {
                 return VI_ERROR_TMO;
         }
+        if (nread == -EPIPE) {
+                // endpoint halted, remembered for the next VI_ATTR_USB_BULK_IN_STATUS
+                s->bulk_in_state = VI_USB_PIPE_STALLED;
+                return VI_ERROR_IO;
+        }
         if (nread < 0) {
-                return  VI_ERROR_IO;
+                return usb_error(s, nread, VI_ERROR_IO);
         }
+        s->read_time = monotonic();
 
     *retCnt = nread;
         return VI_SUCCESS;
 }
 
 
+// not VISA -- called from CCSseries_tryGetScanData
+// Returns a frame of cnt bytes if one is buffered, else VI_SUCCESS_QUEUE_EMPTY
+// at once. The first call starts a thread that keeps reading frames of that
+// size in the background; from then on viRead takes its frames from there
+// too, until viClear, viFlush or viClose stop it.
+ViStatus viTryRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt){
+        ViStatus err;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        if (s->lost) {
+            return VI_ERROR_CONN_LOST;
+        }
+        if (!s->reader_started || (s->frame_size != cnt)) {
+            if ((err = start_reader(s, cnt))) {
+                return err;
+            }
+        }
+        return take_frame(s, buf, cnt, retCnt, 0);
+}
+
+
+// not VISA -- called from CCSseries_getScanData and friends to account for lost scans
+// Returns when the frame viRead or viTryRead handed out last arrived, in
+// seconds on CLOCK_MONOTONIC, and how many frames the read ahead dropped
+// unread since viOpen because nobody took them in time. Either may be NULL.
+ViStatus viGetReadInfo(ViSession vi, ViPReal64 arrival, ViPUInt32 discarded){
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        pthread_mutex_lock(&s->lock);
+        if (arrival) {
+            *arrival = s->read_time;
+        }
+        if (discarded) {
+            *discarded = s->discarded;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return VI_SUCCESS;
+}
+
+
+// not VISA -- called from CCSseries_getScanEventFd
+// Returns a file descriptor for poll/epoll that is readable while viTryRead
+// has a frame of cnt bytes (or an error) to hand out, and starts reading
+// ahead. Do not read from it; viTryRead and viRead keep it up to date.
+// It stays valid until viClose, which closes it.
+ViStatus viGetReadEventFd(ViSession vi, ViUInt32 cnt, ViPInt32 fd){
+        ViStatus err;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        if (s->lost) {
+            return VI_ERROR_CONN_LOST;
+        }
+        if (s->event_fd < 0) {
+            // restart the reader so that its queue and the count agree
+            stop_reader(s);
+            if ((s->event_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+                return VI_ERROR_SYSTEM_ERROR;
+            }
+        }
+        if (!s->reader_started || (s->frame_size != cnt)) {
+            if ((err = start_reader(s, cnt))) {
+                return err;
+            }
+        }
+        *fd = s->event_fd;
+        return VI_SUCCESS;
+}
+
+
+// not VISA -- called from CCSseries_startBurst
+// Has the reader put the next n frames of cnt bytes straight into buf, one
+// after the other, and their arrival times on CLOCK_MONOTONIC in seconds
+// into times if not NULL. buf and times have to stay valid until the burst
+// is complete or stopped by viClear, viFlush, viReconnect or viClose. Once
+// it is complete, frames are queued for viRead and viTryRead again.
+ViStatus viStartBurst(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViUInt32 n, ViReal64 times[]){
+        ViStatus err;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        if (s->lost) {
+            return VI_ERROR_CONN_LOST;
+        }
+        if (!buf || !cnt) {
+            return VI_ERROR_INV_PARAMETER;
+        }
+        stop_reader(s);
+        s->burst_buf = buf;
+        s->burst_time = times;
+        s->burst_n = n;
+        s->burst_done = 0;
+        s->burst_err = VI_SUCCESS;
+        if ((err = start_reader(s, cnt))) {
+            s->burst_n = 0;
+            return err;
+        }
+        return VI_SUCCESS;
+}
+
+
+// not VISA -- called from CCSseries_waitBurst
+// Waits up to timeout ms for the burst to complete, 0 only looks. done is
+// how many frames are in so far. VI_ERROR_TMO while incomplete; the burst
+// goes on. An error that ended the burst is returned from then on.
+ViStatus viWaitBurst(ViSession vi, ViUInt32 timeout, ViPUInt32 done){
+        struct timespec until;
+        ViStatus err;
+        struct session *s = get_session(vi);
+
+        if (!s) {
+            return VI_ERROR_INV_OBJECT;
+        }
+        deadline(&until, timeout);
+        pthread_mutex_lock(&s->lock);
+        while (timeout && (s->burst_done < s->burst_n) && s->reader_run) {
+            if (pthread_cond_timedwait(&s->ready, &s->lock, &until) == ETIMEDOUT) {
+                break;
+            }
+        }
+        *done = s->burst_done;
+        if (s->burst_done >= s->burst_n) {
+            err = s->burst_err;
+            pthread_mutex_unlock(&s->lock);
+            return err;
+        }
+        if (!s->reader_run) {
+            // the reader stopped on an error, report it like viTryRead would
+            err = s->reader_err;
+            event_take(s);
+            pthread_mutex_unlock(&s->lock);
+            stop_reader(s);
+            return err;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return VI_ERROR_TMO;
+}
+
+
 // called from   SPX_writeEEPROM, CCSseries_USB_out
 ViStatus viUsbControlOut(ViSession vi, ViInt16 bmRequestType, ViInt16 bRequest,
                                     ViUInt16 wValue, ViUInt16 wIndex, ViUInt16 wLength,
                                     char* buf){
     int nbytes;
-    nbytes = usb_control_msg(sess.usbhandle, bmRequestType, bRequest, wValue, wIndex, buf, wLength, sess.usbtimeout);
+    struct session *s = get_session(vi);
+
+    if (!s) {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (s->lost) {
+        return VI_ERROR_CONN_LOST;
+    }
+    nbytes = usb_control_msg(s->usbhandle, bmRequestType, bRequest, wValue, wIndex, buf, wLength, s->usbtimeout);
     if (nbytes < 0) {
-        return VI_ERROR_IO;
+        return usb_error(s, nbytes, VI_ERROR_IO);
     }
     return VI_SUCCESS;
 }
@@ -289,10 +1021,18 @@ ViStatus viUsbControlIn(ViSession vi, ViInt16 bmRequestType, ViInt16 bRequest,
                         ViUInt16 wValue, ViUInt16 wIndex,
                         ViUInt16 wLength, char* buf, ViPUInt16 retCnt){
     int nread;
-    nread = usb_control_msg(sess.usbhandle, bmRequestType, bRequest, wValue,
-                                            wIndex, buf, wLength, sess.usbtimeout);
+    struct session *s = get_session(vi);
+
+    if (!s) {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (s->lost) {
+        return VI_ERROR_CONN_LOST;
+    }
+    nread = usb_control_msg(s->usbhandle, bmRequestType, bRequest, wValue,
+                                            wIndex, buf, wLength, s->usbtimeout);
     if (nread < 0){
-        return VI_ERROR_IO;
+        return usb_error(s, nread, VI_ERROR_IO);
     }
     if (retCnt) {
         *retCnt = nread;
@@ -304,29 +1044,86 @@ ViStatus viUsbControlIn(ViSession vi, ViInt16 bmRequestType, ViInt16 bRequest,
 
 
 
+/* Finds the devices matching a VISA search expression such as
+ * CCS_SERIES_FIND_PATTERN or SPX_VI_FIND_RSC_PATTERN. Only the
+ * VI_ATTR_MANF_ID==0x.. and VI_ATTR_MODEL_CODE==0x.. terms are looked at,
+ * any of the model codes matches. Resource names come back in the form
+ * viOpen takes, vid:pid:serial. The bus is scanned once per call. */
+ViStatus viFindRsrc(ViSession sesn, ViString expr, ViPFindList findList, ViPUInt32 retCnt, ViChar desc[]){
+    unsigned short vid = 0;
+    unsigned short pids[MAX_DEVICES];
+    unsigned int v;
+    const char *p;
+    int npid = 0;
+    int i, n;
+
+    if ((p = strstr(expr, "VI_ATTR_MANF_ID==")) && (sscanf(p + 17, "%x", &v) == 1)) {
+        vid = (unsigned short)v;
+    }
+    for (p = expr; (p = strstr(p, "VI_ATTR_MODEL_CODE==")) && (npid < MAX_DEVICES); p++) {
+        if (sscanf(p + 20, "%x", &v) == 1) {
+            pids[npid++] = (unsigned short)v;
+        }
+    }
+
+    pthread_mutex_lock(&rm_lock);
+    nfound = nextfound = 0;
+    if (scan_bus(vid, pids, npid) < 0) {
+        pthread_mutex_unlock(&rm_lock);
+        return VI_ERROR_IO;
+    }
+    for (i = 0; i < ndevices; i++) {
+        snprintf(found[nfound++], VI_FIND_BUFLEN, "%04x:%04x:%s",
+                 devices[i].vid, devices[i].pid, devices[i].serial);
+    }
+    n = nfound;
+    if (n && desc) {
+        strcpy(desc, found[nextfound++]);
+    }
+    pthread_mutex_unlock(&rm_lock);
+
+    if (retCnt) {
+        *retCnt = n;
+    }
+    if (!n) {
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    if (findList) {
+        *findList = (ViFindList)RM_SESSION;
+    }
+    return VI_SUCCESS;
+}
+
+
+// the following resource names of the last viFindRsrc
+// the list is shared by all threads, a viFindRsrc in between starts it over
+ViStatus viFindNext(ViFindList findList, ViChar desc[]){
+    ViStatus err = VI_SUCCESS;
+
+    pthread_mutex_lock(&rm_lock);
+    if (nextfound < nfound) {
+        strcpy(desc, found[nextfound++]);
+    } else {
+        err = VI_ERROR_RSRC_NFOUND;
+    }
+    pthread_mutex_unlock(&rm_lock);
+    return err;
+}
+
+
 /* Find a device on the USB, given vendor and product ID.
  * Returns a handle for the opened device, or NULL if problems */
 struct usb_dev_handle *find_usb_device(int vid, int pid) {
-    struct usb_bus *busses;
-    struct usb_bus *bus;
-    struct usb_device *dev;
-    int ret;
+    struct cached_device *cd;
+    struct usb_dev_handle *h = NULL;
 
-    usb_init();
-    ret = usb_find_busses();
-    if (ret < 0) {
-        fprintf(stderr, "Failed to access /[dev|proc]/bus/usb\n");
-        return NULL;
+    pthread_mutex_lock(&rm_lock);
+    if ((cd = lookup_device(vid, pid, ""))) {
+        h = usb_open(cd->dev);
     }
-    usb_find_devices();
-    busses = usb_get_busses();
-    for (bus = busses; bus; bus = bus->next) {
-        for (dev = bus->devices; dev; dev = dev->next) {
-            if (dev->descriptor.idVendor == vid && dev->descriptor.idProduct == pid) {
-                return usb_open(dev);
-            }
-        }
+    pthread_mutex_unlock(&rm_lock);
+    if (!cd) {
+        fprintf(stderr, "Device not found on USB\n");
     }
-    fprintf(stderr, "Device not found on USB\n");
-    return NULL;
+    return h;
 }
@@ -12,6 +12,8 @@ ViStatus viOpen(ViSession sesn, ViRsrc name, ViAccessMode mode,
 
 ViStatus viClose(ViObject vi);
 
+ViStatus viReconnect(ViSession vi);
+
 ViStatus viClear(ViSession vi);
 
 ViStatus viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue);
@@ -24,10 +26,24 @@ ViStatus viStatusDesc(ViObject vi, ViStatus status, ViChar desc[]);
 
 ViStatus viRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt);
 
+ViStatus viTryRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt);
+
+ViStatus viGetReadInfo(ViSession vi, ViPReal64 arrival, ViPUInt32 discarded);
+
+ViStatus viGetReadEventFd(ViSession vi, ViUInt32 cnt, ViPInt32 fd);
+
+ViStatus viStartBurst(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViUInt32 n, ViReal64 times[]);
+
+ViStatus viWaitBurst(ViSession vi, ViUInt32 timeout, ViPUInt32 done);
+
 ViStatus viUsbControlOut(ViSession vi, ViInt16 bmRequestType, ViInt16 bRequest,
                                     ViUInt16 wValue, ViUInt16 wIndex, ViUInt16 wLength,
                                     char* buf);
                                     
+ViStatus viFindRsrc(ViSession sesn, ViString expr, ViPFindList findList, ViPUInt32 retCnt, ViChar desc[]);
+
+ViStatus viFindNext(ViFindList findList, ViChar desc[]);
+
 ViStatus viUsbControlIn(ViSession vi, ViInt16 bmRequestType, ViInt16 bRequest,
                                     ViUInt16 wValue, ViUInt16 wIndex, ViUInt16 wLength,
                                     char* buf, ViPUInt16 retCnt);
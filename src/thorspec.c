@@ -1,13 +1,22 @@
 // test the CCS series USB driver
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
 #include "CCS_Series_Drv.h"
+#include "ccsstream.h"
+#include "ccsshm.h"
+
+// driver of the device in use, the stream picks it from the vid:pid
+static const ccs_stream_ops_t *family = &CCSstream_opsCCS;
 
 
 void showerr(unsigned long inst, int retcode, char* funcname) {
         char errdesc[CCS_SERIES_ERR_DESCR_BUFFER_SIZE];
-        CCSseries_errorMessage(inst, retcode, errdesc);
-        printf("%s returned %d: %s\n", funcname, retcode, errdesc);
+        family->errorMessage(inst, retcode, errdesc);
+        fprintf(stderr, "%s returned %d: %s\n", funcname, retcode, errdesc);
 }
 
 
@@ -28,11 +37,199 @@ void status(unsigned long inst) {
 }
 
 
+// streaming output format, all fields in host byte order:
+// one file header followed by the wavelength array, then one frame record
+// followed by the scan data for every frame
+#define STREAM_FILE_MAGIC   0x43435331u     // "CCS1"
+#define STREAM_FRAME_MAGIC  0x46524d31u     // "FRM1"
+
+struct stream_file_hdr {
+    unsigned int magic;
+    unsigned int npix;
+    double inttime;
+};
+
+struct stream_frame_hdr {
+    unsigned int magic;
+    unsigned int seq;
+    unsigned int navg;
+    unsigned int npix;
+    double stamp;           // CLOCK_MONOTONIC seconds
+};
+
+static volatile sig_atomic_t stopreq = 0;
+
+static void onsignal(int sig) {
+    stopreq = 1;
+}
+
+
+void usage(char *prog) {
+    fprintf(stderr, "usage: %s vid:pid\n", prog);
+    fprintf(stderr, "       %s -s [-i inttime] [-n frames] [-t seconds] [-a average] [-o sink] [-r prio] [-c cpus] [-l] vid:pid\n", prog);
+    fprintf(stderr, "  -s          stream scans instead of the interactive single scan\n");
+    fprintf(stderr, "  -i inttime  integration time in s\n");
+    fprintf(stderr, "  -n frames   stop after this many output frames\n");
+    fprintf(stderr, "  -t seconds  stop after this many seconds\n");
+    fprintf(stderr, "  -a average  average this many scans into each output frame\n");
+    fprintf(stderr, "  -o sink     output file, - for stdout (default) or shm:/name\n");
+    fprintf(stderr, "  -r prio     run the acquisition thread under SCHED_FIFO at this priority\n");
+    fprintf(stderr, "  -c cpus     mask of the CPUs the acquisition thread may use, e.g. 0x4\n");
+    fprintf(stderr, "  -l          lock the process memory\n");
+}
+
+
+int stream(unsigned long inst, ccs_stream_cfg_t *cfg, char *sink) {
+    double wavdata[CCS_SERIES_NUM_PIXELS];      // first npix used, the largest family
+    ViUInt32 npix = family->npix;
+    struct stream_file_hdr fhdr;
+    struct stream_frame_hdr hdr;
+    ccs_shm_t *shm = NULL;
+    ccs_stream_t *strm;
+    ccs_frame_t *frame;
+    ViUInt32 produced, overruns;
+    ViUInt32 lost, gaps, longest, discarded;
+    ViReal64 overrun;
+    ccs_stream_timing_t tm;
+    FILE *out = NULL;
+    ViStatus ret;
+    int failed = 0;
+
+    ret = family->getWavelengthData(inst, wavdata);
+    if (ret) {
+        showerr(inst, ret, "getwldata");
+        return 1;
+    }
+
+    if (!strncmp(sink, "shm:", 4)) {
+        // ring of the newest frames that local readers use in place, see ccsshm.h
+        ret = CCSshm_create(sink + 4, CCS_SHM_KIND_PROCESSED, npix, 0, wavdata, &shm);
+        if (ret) {
+            showerr(inst, ret, "shmcreate");
+            return 1;
+        }
+    } else {
+        out = strcmp(sink, "-") ? fopen(sink, "wb") : stdout;
+        if (!out) {
+            perror(sink);
+            return 1;
+        }
+        fhdr.magic = STREAM_FILE_MAGIC;
+        fhdr.npix = npix;
+        fhdr.inttime = cfg->intTime;
+        if (fhdr.inttime <= 0.0) family->getIntegrationTime(inst, &fhdr.inttime);
+        fwrite(&fhdr, sizeof(fhdr), 1, out);
+        fwrite(wavdata, sizeof(double), npix, out);
+    }
+
+    signal(SIGINT, onsignal);
+    signal(SIGTERM, onsignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    ret = CCSstream_start(inst, cfg, &strm);
+    if (ret) {
+        showerr(inst, ret, "streamstart");
+        return 1;
+    }
+
+    // the worker keeps reading while we write, so a slow sink only costs
+    // frames once all buffered frames are in use
+    while (!stopreq) {
+        ret = CCSstream_next(strm, &frame, 200);
+        if (ret == VI_ERROR_TMO) continue;
+        if (ret) break;
+
+        hdr.magic = STREAM_FRAME_MAGIC;
+        hdr.seq = frame->seq;
+        hdr.navg = frame->navg;
+        hdr.npix = frame->npix;
+        hdr.stamp = frame->stamp.tv_sec + frame->stamp.tv_nsec * 1e-9;
+
+        if (shm) {
+            CCSshm_publish(shm, frame->seq, frame->navg, &frame->stamp, frame->data);
+        } else if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+                   fwrite(frame->data, sizeof(double), frame->npix, out) != frame->npix) {
+            perror(sink);
+            failed = 1;
+        }
+        CCSstream_release(strm, frame);
+        if (failed) break;
+    }
+
+    CCSstream_stats(strm, &produced, &overruns);
+    CCSstream_timing(strm, &tm);
+    if (ret && ret != VI_WARN_CCS_STREAM_END) {
+        showerr(inst, ret, "stream");
+        failed = 1;
+    }
+    ret = CCSstream_stop(strm);
+    if (ret) {
+        showerr(inst, ret, "streamstop");
+        failed = 1;
+    }
+    fprintf(stderr, "%lu frames written, %lu dropped\n", produced, overruns);
+    fprintf(stderr, "%lu scans, period %.3f ms (%.3f..%.3f, jitter %.3f), latency %.3f ms (max %.3f)\n",
+            tm.scans, tm.periodMean * 1e3, tm.periodMin * 1e3, tm.periodMax * 1e3, tm.jitter * 1e3,
+            tm.latencyMean * 1e3, tm.latencyMax * 1e3);
+    // the worker read the scans through the driver, which kept count; only the CCS driver does
+    if (family == &CCSstream_opsCCS) {
+        CCSseries_getDropStatistics(inst, VI_NULL, &lost, &gaps, &longest, &discarded, &overrun);
+        fprintf(stderr, "%lu scans lost in the device in %lu gaps (longest %lu), %lu discarded, overrun %.2f%%\n",
+                lost, gaps, longest, discarded, overrun * 100.0);
+    }
+
+    if (shm) CCSshm_close(shm);
+    if (out && out != stdout) fclose(out);
+    else if (out) fflush(out);
+    return failed;
+}
+
+
 int main(int argc, char* argv[]) {
     unsigned long inst; //instrument handle  (ViPSession = unsigned long*)
     ViStatus ret;
+    ccs_stream_cfg_t cfg = { 0 };
+    char *sink = "-";
+    int streaming = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "si:n:t:a:o:r:c:lh")) != -1) {
+        switch (opt) {
+        case 's': streaming = 1; break;
+        case 'i': cfg.intTime = atof(optarg); break;
+        case 'n': cfg.frames = strtoul(optarg, NULL, 0); break;
+        case 't': cfg.duration = atof(optarg); break;
+        case 'a': cfg.average = strtoul(optarg, NULL, 0); break;
+        case 'o': sink = optarg; break;
+        case 'r': cfg.rtPriority = atoi(optarg); break;
+        case 'c': cfg.cpus = strtoul(optarg, NULL, 0); break;
+        case 'l': cfg.lockMemory = VI_TRUE; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    family = CCSstream_opsFor(argv[optind]);
+    if (streaming) {
+        ret = family->open(argv[optind], &inst);
+        if (ret) {
+            showerr(inst, ret, "init");
+            return 1;
+        }
+        cfg.ops = family;
+        ret = stream(inst, &cfg, sink);
+        family->close(inst);
+        return ret;
+    }
+    if (family != &CCSstream_opsCCS) {
+        fprintf(stderr, "%s: only streaming (-s) supports SP1-USB/SP2-USB\n", argv[optind]);
+        return 1;
+    }
 
-    ret = CCSseries_init(argv[1],   VI_ON,  VI_ON,      &inst); // read usb vid:pid from command line
+    ret = CCSseries_init(argv[optind],   VI_ON,  VI_ON,      &inst); // read usb vid:pid from command line
     //                   resource name, IDQuery, resetDevice, instrumentHandle
     //ret = CCSseries_init("1313:8081",   VI_OFF,  VI_OFF,      &inst);
     //ret = CCSseries_init("1313:8087",   VI_ON,  VI_ON,      &inst);
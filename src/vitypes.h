@@ -41,6 +41,8 @@ typedef ViUInt32       ViAttrState;
 typedef ViUInt32       ViAccessMode;
 typedef ViUInt32       ViObject;
 typedef ViUInt32       ViAttr;
+typedef ViObject       ViFindList;
+typedef ViFindList*    ViPFindList;
 
 #define VI_SUCCESS (0L)
 #define _VI_FAR
@@ -63,6 +65,10 @@ typedef ViUInt32       ViAttr;
 #define VI_ERROR_TMO                (_VI_ERROR+0x3FFF0015L)
 #define VI_ERROR_RSRC_NFOUND        (_VI_ERROR+0x3FFF0011L)
 #define VI_ERROR_RSRC_BUSY          (_VI_ERROR+0x3FFF0072L)
+#define VI_ERROR_INV_OBJECT         (_VI_ERROR+0x3FFF000EL)
+#define VI_ERROR_CONN_LOST          (_VI_ERROR+0x3FFF00A6L)
+#define VI_ERROR_ABORT              (_VI_ERROR+0x3FFF0010L)
+#define VI_ERROR_NPERMISSION        (_VI_ERROR+0x3FFF00A8L)
 
 #define VI_WARN_NSUP_ID_QUERY     (0x3FFC0101L)
 #define VI_WARN_NSUP_RESET        (0x3FFC0102L)
@@ -70,6 +76,7 @@ typedef ViUInt32       ViAttr;
 #define VI_WARN_NSUP_ERROR_QUERY  (0x3FFC0104L)
 #define VI_WARN_NSUP_REV_QUERY    (0x3FFC0105L)
 #define VI_WARN_UNKNOWN_STATUS    (0x3FFF0085L)
+#define VI_SUCCESS_QUEUE_EMPTY    (0x3FFF0004L)
 
 #define VI_ATTR_TMO_VALUE           (0x3FFF001AUL)
 #define VI_ATTR_USB_BULK_IN_PIPE    (0x3FFF01A3UL)
@@ -93,6 +100,7 @@ typedef ViUInt32       ViAttr;
 #define VI_ON             (1)
 #define VI_USB_END_SHORT  (4)
 #define VI_EXCLUSIVE_LOCK (1)
+#define VI_FIND_BUFLEN    (256)
 
 #define VI_USB_PIPE_STATE_UNKNOWN   (-1)
 #define VI_USB_PIPE_READY           (0)
@@ -0,0 +1,71 @@
+/* C++ interfaces against the simulated device
+ *
+ * Builds ccs.hpp and ccsasync.hpp with C++20 and reads scans through
+ * ccs::Device and ccs::Spectrometer. A change of integration time has to
+ * keep a continuous mode running and label the frames read afterwards with
+ * the new time, both blocking and from the event loop. */
+
+#include <cstdio>
+#include "ccs.hpp"
+#include "ccsasync.hpp"
+#include "usbmock.h"
+
+static int failures;
+
+
+static void expect_time(const char *where, const ccs::Frame &f, ViReal64 t) {
+    if (f.integration_time() != t) {
+        printf("FAIL %s: integration time %g, expected %g\n", where, f.integration_time(), t);
+        failures++;
+    }
+}
+
+
+static void blocking() {
+    ccs::Device dev(USBMOCK_RSRC, 4, false, false);
+
+    dev.set_integration_time(0.002);
+    dev.start_continuous();
+    expect_time("device", dev.read(), 0.002);
+
+    dev.set_integration_time(0.005);
+    expect_time("device after change", dev.read(), 0.005);
+    if (dev.integration_time() != 0.005) {
+        printf("FAIL device: reports %g\n", dev.integration_time());
+        failures++;
+    }
+}
+
+
+static ccs::Task<void> acquire(ccs::Spectrometer &spec) {
+    co_await spec.set_integration_time(0.003);
+    co_await spec.start_continuous();
+    expect_time("loop", co_await spec.next_frame(), 0.003);
+
+    // the read ahead held scans of the old time, and next_frame needs the device scanning
+    co_await spec.set_integration_time(0.004);
+    expect_time("loop after change", co_await spec.next_frame(), 0.004);
+    if (spec.device().integration_time() != 0.004) {
+        printf("FAIL loop: reports %g\n", spec.device().integration_time());
+        failures++;
+    }
+}
+
+
+int main() {
+    try {
+        blocking();
+
+        ccs::EventLoop loop;
+        ccs::Spectrometer spec(loop, USBMOCK_RSRC, 4, false, false);
+
+        loop.spawn(acquire(spec));
+        loop.run();
+    } catch (const std::exception &e) {
+        printf("FAIL %s\n", e.what());
+        failures++;
+    }
+
+    printf("test_async: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+/* Lost scan inference of CCSseries_getDropStatistics
+ *
+ * Plays scripted arrival times to the driver in internal continuous mode
+ * through a simulated CLOCK_MONOTONIC and checks the scans it reports lost
+ * after each one. The device finishes a scan every 4 ms; the host reads
+ * some of them late, which must not count as losses, and misses others,
+ * which must. */
+
+#define _GNU_SOURCE     // syscall
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "CCS_Series_Drv.h"
+#include "usbmock.h"
+
+struct arrival {
+    double ms;          // when the read returns
+    unsigned lost;      // scans lost right before it
+};
+
+static const struct arrival script[] = {
+    { 10.0, 0 }, { 14.0, 0 }, { 18.0, 0 }, { 22.0, 0 },
+    { 28.5, 0 },                // the scan of 26 read 2.5 ms late
+    { 30.0, 0 },                // and the next one on time, 1.5 ms later
+    { 34.0, 0 }, { 38.0, 0 }, { 42.0, 0 }, { 46.0, 0 },
+    { 54.0, 1 },                // 50 missed
+    { 58.0, 0 },
+    { 64.5, 0 },                // 62 read late
+    { 66.0, 0 },
+    { 74.5, 1 },                // 70 missed, 74 read late
+    { 78.0, 0 }, { 82.0, 0 },
+    { 88.0, 0 },                // 86 read late by 2 ms
+    { 90.0, 0 },
+    { 101.0, 1 },               // 94 missed, 98 read 3 ms late
+    { 111.0, 2 },               // 102 and 106 missed, 110 read late
+    { 114.0, 0 },
+};
+#define NSCRIPT     (sizeof(script) / sizeof(script[0]))
+
+static double now = 1.0;        // simulated CLOCK_MONOTONIC in s
+static unsigned pos;
+
+
+// the driver stamps arrivals on CLOCK_MONOTONIC, hand it ours
+int clock_gettime(clockid_t clk, struct timespec *tp) {
+    if (clk != CLOCK_MONOTONIC) {
+        return syscall(SYS_clock_gettime, clk, tp);
+    }
+    tp->tv_sec = (time_t)now;
+    tp->tv_nsec = (long)((now - tp->tv_sec) * 1e9);
+    return 0;
+}
+
+
+static void next_arrival(void) {
+    now = 1.0 + script[pos].ms * 1e-3;
+}
+
+
+int main(void) {
+    static ViReal64 data[CCS_SERIES_NUM_PIXELS];
+    ViSession h;
+    ViStatus err;
+    ViUInt32 lost, dropped, gaps, expect = 0, expgaps = 0;
+    ViReal64 intTime;
+    int failures = 0;
+
+    if ((err = CCSseries_init(USBMOCK_RSRC, VI_OFF, VI_OFF, &h))) {
+        printf("FAIL init: 0x%lx\n", (unsigned long)err);
+        return 1;
+    }
+    usbmock_on_read = next_arrival;
+    CCSseries_setIntegrationTime(h, 0.001);
+    CCSseries_startScanCont(h);
+
+    for (pos = 0; pos < NSCRIPT; pos++) {
+        if ((err = CCSseries_getScanData(h, data))) {
+            printf("FAIL read at %.1f ms: 0x%lx\n", script[pos].ms, (unsigned long)err);
+            return 1;
+        }
+        CCSseries_getScanInfo(h, VI_NULL, &lost, &intTime);
+        if (lost != script[pos].lost) {
+            printf("FAIL at %.1f ms: %lu lost, expected %u\n", script[pos].ms, (unsigned long)lost, script[pos].lost);
+            failures++;
+        }
+        if (intTime != 0.001) {
+            printf("FAIL at %.1f ms: integration time %g\n", script[pos].ms, intTime);
+            failures++;
+        }
+        expect += script[pos].lost;
+        expgaps += (script[pos].lost > 0);
+    }
+
+    CCSseries_getDropStatistics(h, VI_NULL, &dropped, &gaps, VI_NULL, VI_NULL, VI_NULL);
+    if ((dropped != expect) || (gaps != expgaps)) {
+        printf("FAIL totals: %lu lost in %lu gaps, expected %lu in %lu\n",
+               (unsigned long)dropped, (unsigned long)gaps, (unsigned long)expect, (unsigned long)expgaps);
+        failures++;
+    }
+
+    CCSseries_close(h);
+    printf("test_drops: %lu scans lost in %lu gaps, %d failures\n", (unsigned long)dropped, (unsigned long)gaps, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+/* Fixed-point processing against the floating point reference
+ *
+ * Feeds random and edge-case raw scans through CCSseries_getScanData and the
+ * Q16.16 / U16 paths in every processing mode and checks that they agree to
+ * within Q16_BOUND. Edge cases are an all-dark scan, a saturated scan, dark
+ * pixels at full scale and dark levels above the clamp of
+ * CCS_SERIES_PROC_CLAMPED. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "CCS_Series_Drv.h"
+#include "usbmock.h"
+
+#define Q16_BOUND       4.0e-5  // per unit of the value, plus one unit
+#define RANDOM_SCANS    50
+#define DARK_FIRST      16      // dark pixel positions within the raw scan
+#define DARK_LAST       27
+#define SCAN_FIRST      32
+
+// service function of the driver, not in the public header
+ViStatus CCSseries_setDarkCurrentOffset(ViSession instr, ViUInt16 evenOffset, ViUInt16 oddOffset);
+
+static ViReal64 ref[CCS_SERIES_NUM_PIXELS];
+static ViInt32 q16[CCS_SERIES_NUM_PIXELS];
+static ViUInt16 u16[CCS_SERIES_NUM_PIXELS];
+static double maxdev;
+static int failures;
+
+
+static unsigned rnd(unsigned n) {
+    return (unsigned)(((unsigned long long)rand() * n) / ((unsigned long long)RAND_MAX + 1));
+}
+
+
+static void fill(ViUInt16 dark_even, ViUInt16 dark_odd, ViUInt16 lo, ViUInt16 hi) {
+    unsigned i;
+
+    for (i = 0; i < usbmock_scan_words; i++) {
+        usbmock_scan[i] = (ViUInt16)(lo + rnd(hi - lo + 1));
+    }
+    for (i = DARK_FIRST; i <= DARK_LAST; i++) {
+        usbmock_scan[i] = (i & 1) ? dark_odd : dark_even;
+    }
+}
+
+
+// one scan through all three paths, the mock hands out the same scan each time
+static void compare(ViSession h, const char *what) {
+    double d, q, dev, u;
+    int i, bad = 0;
+
+    if (CCSseries_getScanData(h, ref) || CCSseries_getScanDataQ16(h, q16) || CCSseries_getScanDataU16(h, u16)) {
+        printf("FAIL %s: read error\n", what);
+        failures++;
+        return;
+    }
+    for (i = 0; i < CCS_SERIES_NUM_PIXELS; i++) {
+        d = ref[i];
+        q = q16[i] / 65536.0;
+        if (!isfinite(d)) {
+            bad++;
+            continue;
+        }
+        // beyond Q16.16 the fixed point result saturates
+        if (fabs(d) >= 32767.0) {
+            bad += (d > 0) ? (q16[i] != 0x7FFFFFFF) : (q16[i] != -0x7FFFFFFF - 1);
+            continue;
+        }
+        dev = fabs(q - d) / (1.0 + fabs(d));
+        if (dev > maxdev) {
+            maxdev = dev;
+        }
+        bad += (dev > Q16_BOUND);
+
+        u = (d < 0.0) ? 0.0 : (d > 1.0) ? 65535.0 : d * 65535.0;
+        bad += (fabs(u16[i] - u) > 1.0 + 65535.0 * Q16_BOUND * (1.0 + fabs(d)));
+    }
+    if (bad) {
+        printf("FAIL %s: %d pixels out of bound\n", what, bad);
+        failures++;
+    }
+}
+
+
+int main(void) {
+    static const ViInt32 modes[] = { CCS_SERIES_PROC_COMMON, CCS_SERIES_PROC_EVEN_ODD, CCS_SERIES_PROC_CLAMPED };
+    static const char *names[] = { "common", "even/odd", "clamped" };
+    ViReal64 gain[CCS_SERIES_NUM_PIXELS];
+    ViSession h;
+    ViStatus err;
+    char what[64];
+    int m, n, i;
+
+    srand(1);
+    if ((err = CCSseries_init(USBMOCK_RSRC, VI_OFF, VI_OFF, &h))) {
+        printf("FAIL init: 0x%lx\n", (unsigned long)err);
+        return 1;
+    }
+
+    // user amplitude correction between 0.5 and 2
+    for (i = 0; i < CCS_SERIES_NUM_PIXELS; i++) {
+        gain[i] = 0.5 + rnd(1501) / 1000.0;
+    }
+    if ((err = CCSseries_setAmplitudeData(h, gain, CCS_SERIES_NUM_PIXELS, 0, ACOR_APPLY_TO_MEAS)) ||
+        (err = CCSseries_setAmplitudeCorrectionSet(h, ACOR_USE_USER))) {
+        printf("FAIL amplitude correction: 0x%lx\n", (unsigned long)err);
+        return 1;
+    }
+
+    for (m = 0; m < 3; m++) {
+        CCSseries_setProcessingMode(h, modes[m]);
+        // the clamp sits below the dark levels used here, and is off for the other modes
+        CCSseries_setDarkCurrentOffset(h, (modes[m] == CCS_SERIES_PROC_CLAMPED) ? 800 : 0xFFFF,
+                                          (modes[m] == CCS_SERIES_PROC_CLAMPED) ? 900 : 0xFFFF);
+
+        for (n = 0; n < RANDOM_SCANS; n++) {
+            fill((ViUInt16)(500 + rnd(2500)), (ViUInt16)(500 + rnd(2500)), 0, 0xFFFF);
+            snprintf(what, sizeof(what), "%s random %d", names[m], n);
+            compare(h, what);
+        }
+
+        fill(1234, 1234, 1234, 1234);
+        snprintf(what, sizeof(what), "%s all dark", names[m]);
+        compare(h, what);
+
+        fill(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF);
+        snprintf(what, sizeof(what), "%s saturated", names[m]);
+        compare(h, what);
+
+        fill(0xFFFF, 0xFFFE, 0, 0xFFFF);
+        snprintf(what, sizeof(what), "%s dark near full scale", names[m]);
+        compare(h, what);
+
+        fill(0xFFFF, 0xFFFF, 0xFFF0, 0xFFFF);
+        snprintf(what, sizeof(what), "%s dark at full scale", names[m]);
+        compare(h, what);
+    }
+
+    // no clamp at all, so a saturated dark level reaches the denominator
+    CCSseries_setDarkCurrentOffset(h, 0xFFFF, 0xFFFF);
+    fill(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF);
+    compare(h, "clamped saturated, no clamp");
+
+    CCSseries_close(h);
+    printf("test_q16: max deviation %.2g (bound %.2g), %d failures\n", maxdev, Q16_BOUND, failures);
+    return failures ? 1 : 0;
+}
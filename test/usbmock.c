@@ -0,0 +1,114 @@
+/* Simulated CCS spectrometer behind the libusb-0.1 API, linked in place of -lusb
+ *
+ * One device on one bus. EEPROM writes are kept and read back, other
+ * control reads answer zeros, bulk reads return usbmock_scan. That is enough
+ * for the driver to open the device and deliver scans without any hardware. */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <usb.h>
+#include "usbmock.h"
+
+#define SCAN_WORDS  3694    // CCS_SERIES_NUM_RAW_PIXELS
+#define EEPROM_CMD  0x21    // CCS_SERIES_WCMD_WRITE_EEPROM, CCS_SERIES_RCMD_READ_EEPROM
+#define EEPROM_SIZE 0x10000
+
+uint16_t usbmock_scan[SCAN_WORDS];
+unsigned usbmock_scan_words = SCAN_WORDS;
+void (*usbmock_on_read)(void);
+
+static uint8_t eeprom[EEPROM_SIZE];
+static struct usb_device dev;
+static struct usb_bus bus;
+
+
+void usb_init(void) {
+}
+
+int usb_find_busses(void) {
+    return 1;
+}
+
+int usb_find_devices(void) {
+    return 1;
+}
+
+struct usb_bus *usb_get_busses(void) {
+    dev.descriptor.idVendor = USBMOCK_VID;
+    dev.descriptor.idProduct = USBMOCK_PID;
+    dev.descriptor.iSerialNumber = 1;
+    dev.bus = &bus;
+    bus.devices = &dev;
+    return &bus;
+}
+
+usb_dev_handle *usb_open(struct usb_device *d) {
+    return (usb_dev_handle*)d;
+}
+
+int usb_close(usb_dev_handle *h) {
+    return 0;
+}
+
+struct usb_device *usb_device(usb_dev_handle *h) {
+    return (struct usb_device*)h;
+}
+
+int usb_claim_interface(usb_dev_handle *h, int interface) {
+    return 0;
+}
+
+int usb_release_interface(usb_dev_handle *h, int interface) {
+    return 0;
+}
+
+int usb_reset(usb_dev_handle *h) {
+    return 0;
+}
+
+int usb_clear_halt(usb_dev_handle *h, unsigned int ep) {
+    return 0;
+}
+
+int usb_bulk_read(usb_dev_handle *h, int ep, char *bytes, int size, int timeout) {
+    int n = usbmock_scan_words * sizeof(usbmock_scan[0]);
+
+    if (usbmock_on_read) {
+        usbmock_on_read();
+    }
+    if (size < n) {
+        n = size;
+    }
+    memcpy(bytes, usbmock_scan, n);
+    return n;
+}
+
+int usb_bulk_write(usb_dev_handle *h, int ep, char *bytes, int size, int timeout) {
+    return size;
+}
+
+int usb_control_msg(usb_dev_handle *h, int requesttype, int request, int value, int index,
+                    char *bytes, int size, int timeout) {
+    int eep = (request == EEPROM_CMD) && (value + size <= EEPROM_SIZE);
+
+    if (requesttype & USB_ENDPOINT_IN) {
+        if (eep) {
+            memcpy(bytes, eeprom + value, size);
+        } else {
+            memset(bytes, 0, size);
+        }
+    } else if (eep) {
+        memcpy(eeprom + value, bytes, size);
+    }
+    return size;
+}
+
+int usb_get_string_simple(usb_dev_handle *h, int index, char *buf, size_t buflen) {
+    snprintf(buf, buflen, "M%08d", index);
+    return strlen(buf);
+}
+
+char *usb_strerror(void) {
+    return strerror(EIO);
+}
@@ -0,0 +1,27 @@
+/* Simulated CCS spectrometer behind the libusb-0.1 API, linked in place of -lusb */
+
+#ifndef USBMOCK_H
+#define USBMOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USBMOCK_VID     0x1313
+#define USBMOCK_PID     0x8087      // CCS175
+#define USBMOCK_RSRC    "1313:8087"     // resource name as viOpen takes it
+
+// raw scan returned by every bulk read, dark pixels included
+extern uint16_t usbmock_scan[];
+extern unsigned usbmock_scan_words;
+
+// called at the start of every bulk read, e.g. to advance a simulated clock
+extern void (*usbmock_on_read)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif